@@ -0,0 +1,83 @@
+#pragma once
+#include<vector>
+#include<unordered_map>
+#include<cstdint>
+#include<cstddef>
+
+
+// Reduced ordered binary decision diagrams over a fixed number of variables
+// (variable 0 on top), without complement edges. Nodes are not freed one by
+// one: checkpoint() marks the nodes to keep and rollback() drops every node
+// made since, so the nodes of one query do not pile up, and collect() keeps
+// only the nodes below a set of roots
+class BDDManager {
+	public:
+		typedef uint32_t Node;
+		static const Node zero = 0;
+		static const Node one = 1;
+	private:
+		enum OpCode {
+			AND,
+			OR,
+			XOR,
+			EXISTS,
+			AND_EXISTS,
+			SHIFT
+		};
+		struct NodeData {
+			uint32_t var; // n_vars for the terminals
+			Node lo, hi;
+		};
+		struct CacheEntry {
+			uint32_t op;
+			Node a, b, c;
+			Node result;
+		};
+		static const size_t cache_size = 1 << 18;
+
+		int n_vars;
+		std::vector<NodeData> nodes;
+		std::vector<Node> unique_table; // Open addressing, 0 if empty (terminals are not in it)
+		std::vector<CacheEntry> cache;
+		std::vector<std::vector<char>> var_sets;
+		size_t checkpoint_size;
+
+		static size_t hashNode(uint32_t var, Node lo, Node hi);
+		void growTable(size_t table_size);
+		Node makeNode(uint32_t var, Node lo, Node hi);
+		bool cacheLookup(uint32_t op, Node a, Node b, Node c, Node& result) const;
+		void cacheStore(uint32_t op, Node a, Node b, Node c, Node result);
+		Node apply(OpCode op, Node a, Node b);
+		Node shift(Node f, int delta);
+		double countBelow(Node f, const std::vector<int>& n_below, std::unordered_map<Node, double>& counts) const;
+	public:
+		BDDManager(int n_vars_);
+		int numVars() const {return n_vars;}
+		size_t size() const {return nodes.size();}
+		uint32_t var(Node f) const {return nodes[f].var;}
+		Node low(Node f) const {return nodes[f].lo;}
+		Node high(Node f) const {return nodes[f].hi;}
+
+		Node literal(int v, bool value) {return value ? makeNode(v, zero, one) : makeNode(v, one, zero);}
+		Node bddAnd(Node a, Node b) {return apply(AND, a, b);}
+		Node bddOr(Node a, Node b) {return apply(OR, a, b);}
+		Node bddXor(Node a, Node b) {return apply(XOR, a, b);}
+		Node bddNot(Node a) {return apply(XOR, a, one);}
+
+		// Sets of variables to quantify or count over, by id
+		int addVarSet(const std::vector<char>& in_set);
+		Node exists(Node f, int var_set);
+		// exists(f and g, var_set) without building f and g
+		Node andExists(Node f, Node g, int var_set);
+		// Renames every variable v to v + delta, which must keep their order
+		Node shiftVars(Node f, int delta) {return (delta == 0) ? f : shift(f, delta);}
+		// Number of assignments to the variables of 'var_set' satisfying f,
+		// whose support must be in the set
+		double satCount(Node f, int var_set) const;
+
+		void checkpoint() {checkpoint_size = nodes.size();}
+		void rollback();
+		// Drops every node not below one of 'roots', which are renumbered in
+		// place, and checkpoints
+		void collect(const std::vector<Node*>& roots);
+};
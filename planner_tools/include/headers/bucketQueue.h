@@ -0,0 +1,52 @@
+#pragma once
+#include<vector>
+#include<cstddef>
+
+
+// Monotone bucket queue (Dial's algorithm) for small non-negative integer
+// priorities: one bucket per priority value and a cursor that only moves
+// forward, so push and pop are O(1) amortized. Items of equal priority come
+// out in push order. Pushing below the priority of the last pop is not allowed
+class BucketQueue {
+	private:
+		std::vector<std::vector<int>> buckets;
+		std::vector<size_t> heads;
+		size_t cursor, n_items;
+	public:
+		BucketQueue() : cursor(0), n_items(0) {}
+		void clear() {
+			for (auto& bucket : buckets) {
+				bucket.clear();
+			}
+			heads.assign(buckets.size(), 0);
+			cursor = 0;
+			n_items = 0;
+		}
+		bool empty() const {return n_items == 0;}
+		size_t size() const {return n_items;}
+		// Priority of the next pop, the queue must not be empty
+		size_t minPriority() const {
+			size_t priority = cursor;
+			while (heads[priority] == buckets[priority].size()) {
+				++priority;
+			}
+			return priority;
+		}
+		void push(size_t priority, int item) {
+			if (priority >= buckets.size()) {
+				buckets.resize(priority + 1);
+				heads.resize(priority + 1, 0);
+			}
+			buckets[priority].push_back(item);
+			++n_items;
+		}
+		int pop() {
+			while (heads[cursor] == buckets[cursor].size()) {
+				buckets[cursor].clear();
+				heads[cursor] = 0;
+				++cursor;
+			}
+			--n_items;
+			return buckets[cursor][heads[cursor]++];
+		}
+};
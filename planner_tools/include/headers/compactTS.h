@@ -0,0 +1,109 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<cstdint>
+#include<deque>
+
+#include "state.h"
+#include "stateSpace.h"
+#include "condition.h"
+#include "transitionSystem.h"
+#include "stateEncoding.h"
+
+
+// Flat copy of a generated transition system: bit-packed states, edges in
+// compressed sparse row form, interned action labels and one proposition
+// bitset per state. It can be saved as a binary snapshot and
+// mapped back read-only, so the arrays are used in place from the mapping
+class CompactTS {
+	public:
+		typedef uint16_t action_t;
+	private:
+		struct SnapshotHeader {
+			char magic[8];
+			uint32_t version;
+			uint32_t n_states, n_edges, n_dims, n_words, n_actions, n_props, prop_words, init_state;
+			uint64_t key;
+			uint64_t strings_offset, strings_size;
+			uint64_t states_offset, edge_offsets_offset, edge_targets_offset, edge_actions_offset, action_costs_offset, prop_bits_offset;
+			uint64_t file_size;
+		};
+		static const uint32_t snapshot_version = 2;
+
+		StateEncoding encoding;
+		std::vector<std::string> action_labels;
+		std::vector<std::string> prop_labels;
+		int n_states, n_edges, prop_words, init_state;
+
+		// Owned storage, used when the transition system is built in memory
+		std::vector<uint64_t> states_owned;
+		std::vector<uint32_t> edge_offsets_owned, edge_targets_owned;
+		std::vector<action_t> edge_actions_owned;
+		std::vector<float> action_costs_owned;
+		std::vector<uint64_t> prop_bits_owned;
+
+		// Views into either the owned storage or the mapped snapshot
+		const uint64_t* states;
+		const uint32_t* edge_offsets;
+		const uint32_t* edge_targets;
+		const action_t* edge_actions;
+		const float* action_costs;
+		const uint64_t* prop_bits;
+		void* mapped;
+		size_t mapped_size;
+
+		void setOwnedViews();
+		void unmap();
+		std::string stringTable() const;
+		bool parseStringTable(const std::string& table, uint32_t n_dims, uint32_t n_actions, uint32_t n_props);
+		// Every array inside the file and a well formed CSR, so that a
+		// truncated or corrupt snapshot is never read out of bounds
+		static bool validSnapshot(const SnapshotHeader& header, const char* base, uint64_t file_size);
+	public:
+		CompactTS();
+		CompactTS(const CompactTS&) = delete;
+		CompactTS& operator=(const CompactTS&) = delete;
+		~CompactTS();
+
+		// False if the states do not fit in a PackedState
+		bool setDimensions(const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_);
+		void setPropositionLabels(const std::vector<std::string>& prop_labels_);
+		int internAction(const std::string& action_label, float cost);
+		void assign(std::vector<uint64_t>&& states_, std::vector<uint32_t>&& edge_offsets_, std::vector<uint32_t>&& edge_targets_, std::vector<action_t>&& edge_actions_, std::vector<uint64_t>&& prop_bits_, int init_state_);
+
+		// Copy out of / back into a TS_EVAL. The restored states are kept in
+		// 'states' so that their addresses do not depend on TS_EVAL copying them
+		bool build(TS_EVAL<State>& ts, const std::vector<SimpleCondition*>& propositions);
+		void restore(TS_EVAL<State>& ts, StateSpace* SS, std::deque<State>& states) const;
+
+		// Binary snapshot, 'key' identifies the environment and conditions it was generated from
+		bool save(const std::string& filename, uint64_t key) const;
+		bool map(const std::string& filename, uint64_t key);
+		bool isMapped() const {return mapped != nullptr;}
+
+		int size() const {return n_states;}
+		int numEdges() const {return n_edges;}
+		int numDims() const {return encoding.numDims();}
+		int numProps() const {return prop_labels.size();}
+		int numActions() const {return action_labels.size();}
+		int getInitState() const {return init_state;}
+		const StateEncoding& getEncoding() const {return encoding;}
+		const std::vector<std::string>& getPropLabels() const {return prop_labels;}
+
+		PackedState getState(int state) const {
+			PackedState s;
+			for (int i=0; i<encoding.numWords(); ++i) {
+				s.w[i] = states[state * encoding.numWords() + i];
+			}
+			return s;
+		}
+		std::vector<std::string> getStateLabels(int state) const;
+		uint32_t edgeBegin(int state) const {return edge_offsets[state];}
+		uint32_t edgeEnd(int state) const {return edge_offsets[state + 1];}
+		int edgeTarget(uint32_t edge) const {return edge_targets[edge];}
+		int edgeAction(uint32_t edge) const {return edge_actions[edge];}
+		const std::string& actionLabel(int action) const {return action_labels[action];}
+		float actionCost(int action) const {return action_costs[action];}
+		bool hasProp(int state, int prop) const {return (prop_bits[state * prop_words + prop / 64] >> (prop % 64)) & 1u;}
+		void print() const;
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<type_traits>
+
+#include "condition.h"
+#include "stateEncoding.h"
+
+
+// Condition recorded with the same addCondition() calls as a task_planner
+// Condition, and lowered by compile() into a flat list of ops on dimension
+// indices of a PackedState. Argument bindings ("arg" names) become numbered
+// slots that the caller owns, so a compiled condition can be shared between
+// threads. exportCondition() replays the recorded calls into a Condition,
+// which stays the reference (string interpreted) path
+class CompiledCondition {
+	friend class SymbolicTS; // Lowers the compiled programs into BDDs
+	public:
+		typedef std::remove_const<decltype(Condition::PRE)>::type cond_t;
+		struct Binding {
+			int dim; // -1 if unbound
+			int value; // Global label id
+		};
+		struct Transition {
+			PackedState post;
+			int condition; // Index into the conditions it was found with
+		};
+	private:
+		struct SubCondition {
+			cond_t pos, type;
+			std::string label;
+			cond_t op, value_type;
+			std::string value;
+			bool has_arg;
+			cond_t negate;
+			std::string arg;
+		};
+		enum OpCode {
+			LABEL_EQUALS_VAR,
+			LABEL_EQUALS_LABEL,
+			LABEL_ARG_FIND,
+			GROUP_ARG_FIND_VAR,
+			GROUP_ARG_FIND_LABEL,
+			ARG_L_EQUALS_VAR,
+			ARG_L_EQUALS_LABEL,
+			ARG_V_EQUALS_VAR,
+			ARG_V_EQUALS_LABEL
+		};
+		struct Op {
+			OpCode code;
+			bool negate;
+			int dim, dim_2; // Condition label and value label dimensions
+			int value; // Global label id of a VAR value
+			int arg; // Argument slot
+			int group; // Index into 'groups'
+		};
+		struct Program {
+			std::vector<Op> ops;
+			bool disjunction;
+		};
+
+		std::vector<SubCondition> sub_conditions;
+		cond_t pre_junct, post_junct, simple_junct;
+		bool pre_junct_set, post_junct_set, simple_junct_set;
+		std::string action_label, label;
+		float action_cost;
+
+		// Compiled form
+		const StateEncoding* encoding;
+		std::vector<std::vector<int>> label_ids; // Per dimension, label index to global label id
+		std::vector<std::vector<int>> groups;
+		std::vector<std::string> arg_names;
+		Program pre_program, post_program, simple_program;
+		std::vector<int> written_dims; // Dimensions set directly by the post program
+		std::vector<int> written_args; // Argument slots whose dimension is set by the post program
+		bool compiled;
+
+		int globalId(const PackedState& s, int dim) const {return label_ids[dim][encoding->get(s, dim)];}
+		bool run(const Program& program, const PackedState& s, Binding* args) const;
+		bool runOp(const Op& op, const PackedState& s, Binding* args) const;
+		bool compileSub(const SubCondition& sub, std::vector<std::string>& global_labels, Op& op);
+		PackedState writeMask(const Binding* args) const;
+	public:
+		CompiledCondition();
+		void addCondition(cond_t pos, cond_t type, const std::string& label_, cond_t op, cond_t value_type, const std::string& value);
+		void addCondition(cond_t pos, cond_t type, const std::string& label_, cond_t op, cond_t value_type, const std::string& value, cond_t negate, const std::string& arg);
+		void setCondJunctType(cond_t pos, cond_t junct);
+		void setActionLabel(const std::string& action_label_) {action_label = action_label_;}
+		void setActionCost(float action_cost_) {action_cost = action_cost_;}
+		void setLabel(const std::string& label_) {label = label_;}
+		const std::string& getActionLabel() const {return action_label;}
+		float getActionCost() const {return action_cost;}
+		const std::string& getLabel() const {return label;}
+
+		// Reference path
+		void exportCondition(Condition& cond) const;
+		void exportCondition(SimpleCondition& cond) const;
+
+		bool compile(const StateEncoding& encoding_);
+		bool isCompiled() const {return compiled;}
+		int numArgs() const {return arg_names.size();}
+
+		// Transition conditions. evaluatePre() binds 'args' (numArgs() slots),
+		// evaluatePost() also requires every dimension the post conditions do
+		// not set to keep its pre state label
+		bool evaluatePre(const PackedState& pre, Binding* args) const;
+		bool evaluatePost(const PackedState& pre, const PackedState& post, Binding* args) const;
+		bool evaluate(const PackedState& pre, const PackedState& post) const;
+		// Appends every post state of 'pre', in no particular order
+		void successors(const PackedState& pre, std::vector<PackedState>& posts) const;
+		// Replaces 'transitions' with the post states of 'pre' under 'conditions'
+		// in the order the reference path finds them: by the label indices of
+		// the post state, first dimension most significant, each with the first
+		// condition that reaches it. The conditions share one encoding
+		static void orderedSuccessors(const std::vector<CompiledCondition>& conditions, const PackedState& pre, std::vector<Transition>& transitions);
+
+		// Simple conditions (propositions)
+		bool evaluate(const PackedState& state) const;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<climits>
+#include<cstdint>
+
+#include "graph.h"
+
+
+// DFA stored as a dense transition table indexed by (state, letter), where a
+// letter is a bitmask over the DFA's own atomic propositions (bit i set iff
+// ap[i] holds)
+class DenseDFA {
+	private:
+		std::vector<std::string> ap;
+		int n_states, n_letters, init_state;
+		std::vector<char> accepting;
+		std::vector<int> table;
+		std::vector<int> accept_dist;
+		std::string guardFromLetters(const std::vector<unsigned>& letters) const;
+	public:
+		static const int unreachable = INT_MAX;
+
+		DenseDFA();
+		void resize(const std::vector<std::string>& ap_, int n_states_);
+		void setInitState(int init_state_);
+		void setAccepting(int state, bool accepting_);
+		void setTransition(int state, unsigned letter, int next_state);
+		// Build the table from a DFA read by readFileSingle(), by evaluating
+		// every transition guard on every letter. The propositions are the
+		// ones appearing in the guards, at most 'max_ap' of them
+		bool compile(DFA& dfa, int max_ap = 16);
+		// Smallest equivalent DFA: unreachable states are dropped and
+		// equivalent ones merged. Accept distances are computed afterwards
+		void minimize();
+		// Backward breadth first search from the accepting states, run once the
+		// table is complete. acceptDistance() is then the least number of letters
+		// that lead to acceptance, 'unreachable' from dead states
+		void computeAcceptDistances();
+		int acceptDistance(int state) const {return accept_dist[state];}
+		bool hasAcceptDistances() const {return accept_dist.size() == n_states;}
+		// Hash of the propositions, initial state, accepting states and table,
+		// equal for equal automata
+		uint64_t fingerprint() const;
+		const std::vector<std::string>& getAP() const {return ap;}
+		int size() const {return n_states;}
+		int numLetters() const {return n_letters;}
+		int getInitState() const {return init_state;}
+		bool isAccepting(int state) const {return accepting[state];}
+		int step(int state, unsigned letter) const {return table[state * n_letters + letter];}
+		// Write the automaton into the DFA type consumed by DFA_EVAL
+		void exportDFA(DFA& dfa) const;
+		void print() const;
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<unordered_map>
+#include<unordered_set>
+#include<chrono>
+#include<sys/types.h>
+
+#include "graph.h"
+#include "ltlfTranslator.h"
+
+
+// Long-lived formula2dfa.py process fed one formula per line over a socket
+// pair, so that the interpreter start-up and Spot import are only paid once.
+// Writes use MSG_NOSIGNAL, a dead worker is an error rather than a SIGPIPE
+class TranslatorWorker {
+	public:
+		typedef std::chrono::steady_clock::time_point time_point;
+	private:
+		const std::string python_executable, worker_script, formula2dfa_path;
+		pid_t pid;
+		int fd; // Worker's stdin and stdout
+		std::string read_buffer; // Read past the last reply line
+		bool start();
+		// Waits a bounded time for the worker to exit, then kills it
+		void stop();
+		void kill();
+		// False on a broken connection or once 'stop_time' has passed
+		bool writeAll(const std::string& data, time_point stop_time);
+		bool readLine(std::string& line, time_point stop_time);
+	public:
+		TranslatorWorker(const std::string& python_executable_, const std::string& worker_script_, const std::string& formula2dfa_path_);
+		// Translate a single formula, writing the dfa file to 'dfa_filename'.
+		// A worker still busy at 'stop_time' is killed and restarted
+		bool translate(const std::string& formula, const std::string& dfa_filename, time_point stop_time = time_point::max());
+		bool isRunning() const;
+		~TranslatorWorker();
+};
+
+// Content-addressed DFA cache. DFAs are keyed by the normalized formula
+// string and kept in memory for the life of the node. Formulas in the native
+// translator's fragment are translated in-process, anything else goes to the
+// translator worker and is stored on disk under the hash of the key so that
+// restarts do not need the worker either
+class DFACache {
+	private:
+		const std::string cache_dir;
+		LTLfTranslator* native_translator;
+		TranslatorWorker* worker;
+		std::unordered_map<std::string, DFA> dfas;
+		std::unordered_map<std::string, DenseDFA> dense_dfas;
+		std::unordered_set<std::string> dense_failures; // Keys whose DFA does not compile to a DenseDFA
+		int hits, native_translations, disk_hits, misses;
+		std::string filenameFromKey(const std::string& key, const std::string& extension) const;
+		bool readFromDisk(const std::string& key, DFA& dfa) const;
+	public:
+		DFACache(const std::string& cache_dir_, LTLfTranslator* native_translator_, TranslatorWorker* worker_);
+		static std::string normalize(const std::string& formula);
+		static std::string hashKey(const std::string& key);
+		// Returns nullptr if the formula could not be translated, or not before
+		// 'stop_time' by the worker. Returned pointers remain valid for the
+		// life of the cache
+		DFA* get(const std::string& formula, TranslatorWorker::time_point stop_time = TranslatorWorker::time_point::max());
+		// Same language as a minimal dense transition table, nullptr if it
+		// can not be compiled. Failures are remembered, not retried
+		DenseDFA* getDense(const std::string& formula, TranslatorWorker::time_point stop_time = TranslatorWorker::time_point::max());
+		bool contains(const std::string& formula) const;
+		int size() const;
+		void printStats() const;
+};
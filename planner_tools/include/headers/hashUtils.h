@@ -0,0 +1,18 @@
+#pragma once
+#include<cstdint>
+#include<string>
+
+
+// 64 bit FNV-1a, used for on-disk cache keys
+inline uint64_t fnv1a(const void* data, size_t n_bytes, uint64_t hash = 14695981039346656037ull) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i=0; i<n_bytes; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+inline uint64_t fnv1a(const std::string& str, uint64_t hash = 14695981039346656037ull) {
+	return fnv1a(str.data(), str.size(), hash);
+}
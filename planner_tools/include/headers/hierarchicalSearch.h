@@ -0,0 +1,75 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<cstdint>
+#include<chrono>
+
+#include "compactTS.h"
+#include "lazyTS.h"
+#include "denseDFA.h"
+#include "productSearch.h"
+
+
+// Two level planning. The preference DFAs are first searched against an
+// abstract TS whose dimensions are a subset of the concrete ones (e.g. the
+// object locations without eeLoc and holding), and every abstract step is
+// then refined into the cheapest concrete path from the current concrete
+// state to a state projecting onto the next abstract state, only through
+// states projecting onto one of the two. Concrete labels are matched to
+// abstract ones by name.
+//
+// The DFAs are run again over the refined plan: it is only returned if every
+// DFA accepts and its path length and cost vector are those the abstract
+// search optimized, otherwise search() fails and the caller plans over the
+// concrete TS instead. The abstract TS must label the same propositions
+class HierarchicalSearch {
+	private:
+		LazyTS* abstract_ts;
+		const CompactTS* ts;
+		LazyTS* lazy_ts; // Refined into instead of ts if set
+		ProductSearch abstract_search;
+		std::vector<const DenseDFA*> dfas;
+		std::chrono::steady_clock::time_point stop_time; // Also bounds the refinement
+
+		// Per abstract dimension, its concrete dimension and the abstract label
+		// index of each concrete label (-1 if the abstract one has none)
+		std::vector<int> concrete_dims;
+		std::vector<std::vector<int>> label_map;
+
+		// Result
+		bool success;
+		float path_length;
+		std::vector<float> cost_vector;
+		std::vector<int> state_sequence;
+		std::vector<int> action_sequence;
+		int n_abstract_steps;
+
+		bool mapDims(const StateEncoding& encoding);
+		int project(const StateEncoding& encoding, const PackedState& s, const PackedState& a, const PackedState& b) const;
+		void expand(const CompactTS& trans_sys, int state) {}
+		void expand(LazyTS& trans_sys, int state) {trans_sys.expand(state);}
+		template<class TS> bool refineStep(TS& trans_sys, int& state, const PackedState& from, const PackedState& to);
+		template<class TS> bool refine(TS& trans_sys);
+		template<class TS> bool verify(const TS& trans_sys);
+	public:
+		HierarchicalSearch(LazyTS* abstract_ts_, const CompactTS* ts_);
+		HierarchicalSearch(LazyTS* abstract_ts_, LazyTS* lazy_ts_);
+		void setAutomata(const std::vector<const DenseDFA*>& dfas_);
+		void setFlexibility(float flexibility) {abstract_search.setFlexibility(flexibility);}
+		// See ProductSearch, set before setAutomata()
+		void setStopTime(std::chrono::steady_clock::time_point stop_time_) {stop_time = stop_time_; abstract_search.setStopTime(stop_time_);}
+		// Dimensions of the abstract TS, see ProductSearch
+		void setInterchangeable(const std::vector<int>& dims) {abstract_search.setInterchangeable(dims);}
+		const StateEncoding& getAbstractEncoding() const {return abstract_ts->getEncoding();}
+		bool search();
+
+		bool getSuccess() const {return success;}
+		float getPathLength() const {return path_length;}
+		const std::vector<float>& getCostVector() const {return cost_vector;}
+		bool getComplete() const {return abstract_search.getComplete();}
+		float getSuboptimality() const {return abstract_search.getSuboptimality();}
+		// Concrete TS state ids and action ids
+		const std::vector<int>& getStateSequence() const {return state_sequence;}
+		const std::vector<int>& getActionSequence() const {return action_sequence;}
+		void print() const;
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<unordered_map>
+#include<cstdint>
+
+#include "stateEncoding.h"
+#include "compiledCondition.h"
+#include "compactTS.h"
+
+
+// Transition system built on demand: a state's successors are computed from
+// the compiled conditions the first time they are asked for and kept, so
+// only the states a search touches are ever generated. Successors are listed
+// in the same order as TSGenerator, but state ids are handed out in order of
+// discovery, so they differ from those of the generated TS. Not thread safe
+class LazyTS {
+	public:
+		typedef CompactTS::action_t action_t;
+	private:
+		static const uint32_t unexpanded = UINT32_MAX;
+
+		StateEncoding encoding;
+		std::vector<CompiledCondition> conditions;
+		std::vector<CompiledCondition> propositions;
+		std::vector<int> action_inds; // Action of each condition
+		std::vector<std::string> action_labels;
+		std::vector<float> action_costs;
+		std::vector<std::string> prop_labels;
+		int prop_words, init_state;
+
+		std::unordered_map<PackedState, int, PackedStateHash> ids;
+		std::vector<uint64_t> states;
+		std::vector<uint64_t> prop_bits;
+
+		// Edges of each expanded state are contiguous, unexpanded states have
+		// edge_begin == unexpanded
+		std::vector<uint32_t> edge_begin, edge_end;
+		std::vector<uint32_t> edge_targets;
+		std::vector<action_t> edge_actions;
+		int n_expanded;
+
+		int internState(const PackedState& s);
+	public:
+		LazyTS(const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_);
+		void setLabelGroup(const std::string& group, const std::vector<std::string>& group_dim_names);
+		void setConditions(const std::vector<CompiledCondition>& conditions_);
+		void setPropositions(const std::vector<CompiledCondition>& propositions_);
+		// Compiles the conditions and starts over from the initial state
+		bool setInitState(const std::vector<std::string>& init_state_labels);
+
+		// Computes the successors of 'state' unless it has been expanded before
+		void expand(int state) {
+			if (edge_begin[state] == unexpanded) {
+				expandState(state);
+			}
+		}
+		void expandState(int state);
+		bool isExpanded(int state) const {return edge_begin[state] != unexpanded;}
+		// Id of 's', which is added unexpanded if it has not been discovered
+		int stateId(const PackedState& s) {return internState(s);}
+
+		int size() const {return edge_begin.size();}
+		int numEdges() const {return edge_targets.size();}
+		int numExpanded() const {return n_expanded;}
+		int numProps() const {return prop_labels.size();}
+		int numActions() const {return action_labels.size();}
+		int getInitState() const {return init_state;}
+		const StateEncoding& getEncoding() const {return encoding;}
+		const std::vector<std::string>& getPropLabels() const {return prop_labels;}
+
+		PackedState getState(int state) const {
+			PackedState s;
+			for (int i=0; i<encoding.numWords(); ++i) {
+				s.w[i] = states[state * encoding.numWords() + i];
+			}
+			return s;
+		}
+		std::vector<std::string> getStateLabels(int state) const {return encoding.decode(getState(state));}
+		// Edges of an expanded state
+		uint32_t edgeBegin(int state) const {return edge_begin[state];}
+		uint32_t edgeEnd(int state) const {return edge_end[state];}
+		int edgeTarget(uint32_t edge) const {return edge_targets[edge];}
+		int edgeAction(uint32_t edge) const {return edge_actions[edge];}
+		const std::string& actionLabel(int action) const {return action_labels[action];}
+		float actionCost(int action) const {return action_costs[action];}
+		bool hasProp(int state, int prop) const {return (prop_bits[state * prop_words + prop / 64] >> (prop % 64)) & 1u;}
+		void print() const;
+};
@@ -0,0 +1,61 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<unordered_map>
+
+#include "denseDFA.h"
+
+
+// In-process LTLf to DFA translation for the fragment used by the preference
+// queries: F, G, U, X, &, |, ! (and ->) over atomic propositions. The DFA is
+// built by formula progression; a DFA state is the remaining obligation
+// together with whether the word read so far satisfies the formula.
+class LTLfTranslator {
+	public:
+		enum Op {TRUE_F, FALSE_F, AP, NOT_AP, AND, OR, NEXT, WEAK_NEXT, EVENTUALLY, ALWAYS, UNTIL, RELEASE};
+	private:
+		struct Node {
+			Op op;
+			int ap;
+			std::vector<int> args;
+		};
+		// Raw parse tree, negations are pushed down when building the nodes
+		struct RawNode {
+			char op;
+			int ap;
+			int lhs, rhs;
+		};
+		const int max_ap, max_states;
+		std::vector<RawNode> raw_nodes;
+		std::vector<Node> nodes;
+		std::unordered_map<std::string, int> unique_nodes;
+		std::unordered_map<unsigned long long, std::pair<int, bool>> prog_memo;
+		std::vector<std::string> ap;
+		std::string error;
+
+		// Parser
+		std::vector<std::string> tokens;
+		int tok_i;
+		bool tokenize(const std::string& formula);
+		int parseImplies();
+		int parseOr();
+		int parseAnd();
+		int parseBinaryTemporal();
+		int parseUnary();
+		int addRaw(char op, int ap_ind, int lhs, int rhs);
+
+		// Hash consed negation normal form
+		int mkNode(Op op, int ap_ind, const std::vector<int>& args);
+		int mkJunction(Op op, const std::vector<int>& args);
+		int nnf(int raw_ind, bool negate);
+
+		// Returns the progressed obligation and whether the single letter word satisfies the node
+		std::pair<int, bool> progress(int node_ind, unsigned letter);
+		void clear();
+	public:
+		LTLfTranslator(int max_ap_ = 12, int max_states_ = 4096);
+		// Parse only, returns the atomic propositions of the formula
+		bool parse(const std::string& formula, std::vector<std::string>& ap_out);
+		bool translate(const std::string& formula, DenseDFA& dfa);
+		const std::string& getError() const {return error;}
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<cstdint>
+
+#include "compactTS.h"
+
+
+// Projections of a CompactTS onto small groups of its state dimensions
+// (patterns), e.g. (eeLoc, object, holding) for each object. Every edge of
+// the TS is mapped onto its pattern states with the cheapest cost, so a path
+// in the TS is never cheaper than its projection and shortest paths in a
+// pattern are admissible. The pattern graphs are kept reversed (edges into
+// each pattern state) for backward searches from the goal, along with the
+// pattern state of every TS state. Built once per TS and saved next to its
+// snapshot
+class PatternDB {
+	private:
+		struct Pattern {
+			std::vector<int> dims;
+			uint32_t size;
+			std::vector<uint32_t> in_offsets; // size + 1
+			std::vector<uint32_t> in_sources;
+			std::vector<float> in_costs;
+		};
+		struct FileHeader {
+			char magic[8];
+			uint32_t version;
+			uint32_t n_states, n_patterns;
+			uint64_t key;
+		};
+		static const uint32_t file_version = 1;
+
+		std::vector<Pattern> patterns;
+		std::vector<uint32_t> pattern_states; // n_patterns per TS state
+		int n_states;
+	public:
+		PatternDB();
+		bool build(const CompactTS& ts, const std::vector<std::vector<std::string>>& pattern_dim_names);
+
+		// 'key' identifies the TS and the patterns
+		bool save(const std::string& filename, uint64_t key) const;
+		bool load(const std::string& filename, uint64_t key, const CompactTS& ts);
+
+		int numPatterns() const {return patterns.size();}
+		int numStates() const {return n_states;}
+		uint32_t patternSize(int pattern) const {return patterns[pattern].size;}
+		uint32_t patternState(int state, int pattern) const {return pattern_states[state * patterns.size() + pattern];}
+		uint32_t inBegin(int pattern, uint32_t pattern_state) const {return patterns[pattern].in_offsets[pattern_state];}
+		uint32_t inEnd(int pattern, uint32_t pattern_state) const {return patterns[pattern].in_offsets[pattern_state + 1];}
+		uint32_t inSource(int pattern, uint32_t edge) const {return patterns[pattern].in_sources[edge];}
+		float inCost(int pattern, uint32_t edge) const {return patterns[pattern].in_costs[edge];}
+		void print() const;
+};
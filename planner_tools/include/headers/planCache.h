@@ -0,0 +1,66 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<list>
+#include<unordered_map>
+#include<cstdint>
+
+#include "stateEncoding.h"
+
+
+// Bounded LRU cache of complete plans, keyed by the hash of a canonical
+// string of the query: the transition system, the start state, the
+// normalized formulas in order and the flexibility. The string is kept with
+// each plan so that a hash collision is a miss. States are stored packed
+// rather than by id, ids of a lazy TS depend on the order it was expanded
+// in. With a file, the cache is loaded from it on construction and written
+// back by flush(), which the owner calls periodically, and on destruction
+class PlanCache {
+	public:
+		struct Entry {
+			bool success;
+			float path_length;
+			float suboptimality;
+			std::vector<float> cost_vector;
+			std::vector<PackedState> state_sequence;
+			std::vector<std::string> action_sequence;
+		};
+	private:
+		struct FileHeader {
+			char magic[8];
+			uint32_t version;
+			uint32_t n_entries;
+		};
+		static const uint32_t file_version = 1;
+		struct Node {
+			uint64_t hash;
+			std::string key;
+			Entry entry;
+		};
+
+		const size_t capacity;
+		const std::string filename;
+		std::list<Node> lru; // Most recently used first
+		std::unordered_map<uint64_t, std::list<Node>::iterator> index;
+		uint64_t lookups, hits;
+		bool dirty; // Changed since the file was last written
+		bool load();
+		bool save() const;
+	public:
+		// A capacity of 0 disables the cache, an empty filename keeps it in memory only
+		PlanCache(size_t capacity_, const std::string& filename_);
+		~PlanCache();
+		static std::string makeKey(uint64_t ts_key, const PackedState& start_state, const std::vector<std::string>& formulas, float flexibility);
+		// nullptr on a miss. The entry is valid until the next insertion
+		const Entry* find(const std::string& key);
+		void insert(const std::string& key, const Entry& entry);
+		void clear();
+		// Writes the file if there is one and the cache changed since the last write
+		bool flush();
+		bool enabled() const {return capacity > 0;}
+		size_t size() const {return lru.size();}
+		uint64_t numLookups() const {return lookups;}
+		uint64_t numHits() const {return hits;}
+		double hitRate() const;
+		void printStats() const;
+};
@@ -0,0 +1,255 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<map>
+#include<unordered_map>
+#include<cstdint>
+#include<chrono>
+
+#include "compactTS.h"
+#include "lazyTS.h"
+#include "patternDB.h"
+#include "denseDFA.h"
+#include "bucketQueue.h"
+#include "workerPool.h"
+
+
+// Search over the product of a CompactTS (or a LazyTS) and the preference
+// DFAs. A product node is (TS state, q_1, ..., q_n). A path has length g (sum
+// of action costs) and cost vector c, where c_i sums the action costs taken
+// while DFA i is not accepting. The plan ends where every DFA accepts and,
+// among the plans with g <= g* + flexibility, has the lexicographically
+// smallest c. Labels (g, c) are settled in order of g and only kept at a node
+// if their c is smaller than that of every label settled there before
+class ProductSearch {
+	public:
+		struct FrontPoint {
+			float flexibility; // Smallest flexibility that selects this plan
+			float path_length;
+			std::vector<float> cost_vector;
+			std::vector<int> state_sequence;
+			std::vector<int> action_sequence;
+		};
+	private:
+		struct Label {
+			float g;
+			int node;
+			int parent; // Label the node was reached from, -1 for the root
+			int action;
+		};
+		// Interned product nodes, 1 + n_dfas ints each
+		struct NodeTable {
+			std::vector<int> keys;
+			std::vector<int> slots; // Open addressing, -1 if empty
+			std::vector<int> best_label; // Label with the smallest c settled at each node, -1 if none
+			std::vector<float> h; // Admissible estimate of the path length left
+			std::vector<float> bounds; // n_dfas per node, cost left until each DFA accepts
+			void clear() {
+				keys.clear();
+				slots.clear();
+				best_label.clear();
+				h.clear();
+				bounds.clear();
+			}
+		};
+		// Labels sent to another partition, with their node keys (1 + n_dfas
+		// ints each) and cost vectors. 'node' is unset until delivered
+		struct Outbox {
+			std::vector<Label> labels;
+			std::vector<int> parent_states;
+			std::vector<int> keys;
+			std::vector<float> costs;
+			void clear() {
+				labels.clear();
+				parent_states.clear();
+				keys.clear();
+				costs.clear();
+			}
+		};
+		// Share of the product nodes of one worker in a parallel pass. Label
+		// parents are global: label * partitions.size() + partition
+		struct Partition {
+			NodeTable nodes;
+			std::vector<Label> labels;
+			std::vector<float> label_costs;
+			std::vector<int> parent_states; // TS state of each label's parent
+			BucketQueue bucket_queue;
+			std::vector<Outbox> outboxes; // Per receiving partition
+			std::vector<int> goals; // Settled in the current bucket
+			std::vector<int> shortcut_targets;
+			int n_expanded;
+		};
+		struct QueueEntry {
+			float f;
+			int label;
+		};
+		// DFA steps are table lookups on a letter precomputed per TS state and
+		// proposition alphabet. Over a LazyTS letters are added as states are
+		// discovered
+		struct LetterTable {
+			std::vector<int> props; // TS proposition of each DFA proposition, -1 if the TS does not label it
+			std::vector<uint32_t> letters; // DFA letter of each TS state
+		};
+
+		const CompactTS* ts;
+		LazyTS* lazy_ts; // Searched instead of ts if set
+		std::vector<const DenseDFA*> dfas;
+		std::vector<LetterTable*> letters;
+		std::map<std::vector<std::string>, LetterTable> letter_tables;
+		float flexibility;
+		int n_dfas;
+		std::chrono::steady_clock::time_point stop_time; // max() for none
+		float weight; // Of the heuristic in the current pass
+
+		NodeTable nodes;
+		bool use_accept_dist; // Every DFA has its distances to acceptance
+		float min_action_cost;
+		// Lower bounds b_i on the cost left until DFA i accepts, h = max_i b_i:
+		// the distance to acceptance times the cheapest action cost, the cost
+		// to acceptance in the product of the DFA with each pattern of a
+		// PatternDB, or with an accept table the exact cost in the product of
+		// the CompactTS with the DFA alone. Nodes where a DFA can no longer
+		// accept are dropped, and so are labels whose bound on c is not below
+		// the c of the plan found
+		const PatternDB* pattern_db;
+		std::vector<std::vector<float>> pattern_dists; // Per (DFA, pattern), cost to acceptance from (pattern state, DFA state)
+		static const int max_pattern_table = 1 << 24;
+		// By DFA fingerprint, cost to acceptance from (TS state, DFA state). Kept
+		// across setAutomata() calls so that only new formulas are computed
+		std::unordered_map<uint64_t, std::vector<float>> accept_tables;
+		std::vector<const std::vector<float>*> accept_dists; // Table of each DFA, nullptr if none
+		size_t max_accept_entries; // Over every kept table
+		std::vector<uint32_t> in_offsets, in_sources; // Reversed edges of the CompactTS, built on first use
+		std::vector<float> in_costs;
+		bool has_heuristic; // Weighted passes can be informed
+
+		std::vector<int> start_path; // TS states read before the search, which starts at the last one. Empty for the initial state
+
+		// Interchangeable dimensions are sorted in every product node. The plan
+		// found in the quotient is mapped back onto the TS by following edges
+		// with the same actions from the real start state
+		std::vector<int> sym_dims;
+		bool reduced; // The current search sorts sym_dims
+		bool sym_failed; // Some sorted state is not in the TS
+		std::vector<int> canon_states; // Sorted state of each TS state, -1 if not computed
+		std::unordered_map<PackedState, int, PackedStateHash> state_index; // Of the CompactTS, built on first use
+		std::vector<uint32_t> sym_labels;
+		// Targets the parent state of the label being expanded reaches with its
+		// action. A move repeating that action that no DFA sees is skipped if
+		// its target is among them (e.g. two transits in a row)
+		std::vector<int> shortcut_targets;
+
+		std::vector<Label> labels;
+		std::vector<float> label_costs; // n_dfas per label
+		std::vector<QueueEntry> queue;
+		// With small non-negative integer costs the open list is a bucket queue
+		// on g, otherwise a heap on (g, c). The pruning only needs g order
+		BucketQueue bucket_queue;
+		bool use_buckets;
+		static const int max_bucket_cost = 255;
+
+		// HDA* exact pass over a CompactTS with integer costs: product nodes
+		// belong to the partition their key hashes to, and the partitions settle
+		// one bucket of f at a time in rounds of expansion and delivery, so the
+		// plan has the same g and c as the serial pass
+		WorkerPool* pool; // Runs the exact pass if set
+		std::vector<Partition> partitions;
+		bool parallel_pass; // The last exact pass ran on the pool
+
+		// Result
+		bool success;
+		float path_length;
+		std::vector<float> cost_vector;
+		std::vector<int> state_sequence;
+		std::vector<int> action_sequence;
+		// Goal labels improving on c, in order of g. Each smaller flexibility
+		// selects one of them
+		std::vector<int> goal_front;
+		bool complete;
+		float suboptimality;
+		int n_expanded;
+
+		template<class TS> LetterTable& letterTable(const TS& trans_sys, const DenseDFA& dfa);
+		template<class TS> void extendLetters(const TS& trans_sys, LetterTable& table) const;
+		void expand(const CompactTS& trans_sys, int state) {}
+		void expand(LazyTS& trans_sys, int state);
+		template<class TS> int startState(const TS& trans_sys) const {return start_path.empty() ? trans_sys.getInitState() : start_path.back();}
+		template<class TS> void rootKey(TS& trans_sys, int* key);
+		int findState(const CompactTS& trans_sys, const PackedState& s);
+		int findState(LazyTS& trans_sys, const PackedState& s);
+		template<class TS> int canonical(TS& trans_sys, int state);
+		template<class TS> bool liftPlan(TS& trans_sys, std::vector<int>& states, const std::vector<int>& actions);
+		int internNode(NodeTable& table, const int* key) const;
+		bool lexLess(const float* c_1, const float* c_2) const;
+		bool queueLess(const QueueEntry& a, const QueueEntry& b) const;
+		void push(int label);
+		int pop();
+		bool queueEmpty() const;
+		template<class TS> bool integerCosts(const TS& trans_sys) const;
+		template<class TS> float minActionCost(const TS& trans_sys) const;
+		bool acceptTable(const DenseDFA& dfa, const std::vector<uint32_t>& state_letters, std::vector<float>& dist);
+		void computeAcceptTables();
+		void computePatternDists();
+		void dfaBounds(const int* key, float* bounds) const;
+		bool deadKey(const int* key) const;
+		bool canImprove(const float* c, const float* bounds, const float* goal_c) const;
+		void resetPass();
+		bool hasStopTime() const {return stop_time != std::chrono::steady_clock::time_point::max();}
+		bool pastStopTime() const {return hasStopTime() && std::chrono::steady_clock::now() > stop_time;}
+		template<class TS> int runPass(TS& trans_sys, bool first_goal_only, bool& timed_out);
+		int partitionOf(const int* key) const;
+		void deliver(Partition& part, const Label& label, int parent_state, const int* key, const float* c, float bound, const float* goal_c) const;
+		void expandBucket(int p, size_t bucket, float bound, const float* goal_c);
+		int importLabel(int ref, std::unordered_map<int, int>& imported);
+		int runParallelPass(bool& timed_out);
+		void runPasses();
+		void setResult(int goal_label);
+		bool extractPlan(int goal_label, std::vector<int>& states, std::vector<int>& actions);
+	public:
+		ProductSearch(const CompactTS* ts_);
+		ProductSearch(LazyTS* lazy_ts_);
+		void setAutomata(const std::vector<const DenseDFA*>& dfas_);
+		void setFlexibility(float flexibility_) {flexibility = flexibility_;}
+		// Absolute, time_point::max() (the default) for none. It also bounds
+		// the tables setAutomata() computes, so set it first. With a stop time
+		// and a heuristic, weighted passes (w decreasing) each stop at their
+		// first goal before the exact pass, and the best plan so far is kept
+		// when the stop time is reached
+		void setStopTime(std::chrono::steady_clock::time_point stop_time_) {stop_time = stop_time_;}
+		// Used with the CompactTS it was built from, before setAutomata()
+		void setPatternDB(const PatternDB* pattern_db_) {pattern_db = pattern_db_;}
+		// Entries (TS state, DFA state) of the exact tables kept over a
+		// CompactTS, 0 (the default) for none. Set before setAutomata()
+		void setAcceptTableSize(size_t max_accept_entries_) {max_accept_entries = max_accept_entries_;}
+		// Not to be shared with searches running on the same pool
+		void setWorkerPool(WorkerPool* pool_) {pool = pool_;}
+		// Id of a TS state, -1 if the CompactTS does not have it (a hash index
+		// built on first use). A LazyTS state is added if it is new
+		int stateId(const PackedState& s) {return lazy_ts ? findState(*lazy_ts, s) : findState(*ts, s);}
+		// Searches from this TS state instead of the initial one, -1 for the
+		// initial one
+		void setStartState(int state) {start_path.assign((state >= 0) ? 1 : 0, state);}
+		// Searches on from the end of a path that has been followed, with the
+		// DFAs in the states reading its labels left them in. Empty for the
+		// initial state
+		void setStartPath(const std::vector<int>& states) {start_path = states;}
+		// Dimensions whose labels may be permuted without changing the
+		// conditions or any proposition the formulas use. If a sorted state
+		// is not in the TS the search runs again without the reduction
+		void setInterchangeable(const std::vector<int>& dims);
+		bool search();
+
+		bool getSuccess() const {return success;}
+		float getPathLength() const {return path_length;}
+		const std::vector<float>& getCostVector() const {return cost_vector;}
+		// False if the stop time was reached before the plan was proven
+		bool getComplete() const {return complete;}
+		// The path length is at most this factor times the shortest one
+		float getSuboptimality() const {return suboptimality;}
+		// TS state ids and action ids of the plan, one more state than actions
+		const std::vector<int>& getStateSequence() const {return state_sequence;}
+		const std::vector<int>& getActionSequence() const {return action_sequence;}
+		// Plans for every flexibility up to the one searched with
+		void getFront(std::vector<FrontPoint>& front);
+		void print() const;
+};
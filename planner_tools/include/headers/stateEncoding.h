@@ -0,0 +1,69 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<cstdint>
+#include<unordered_map>
+
+
+// State packed into at most two machine words. Each dimension is stored as
+// the index of its label in ceil(log2(#labels)) bits
+struct PackedState {
+	uint64_t w[2];
+	PackedState() : w{0, 0} {}
+	bool operator==(const PackedState& other) const {return w[0] == other.w[0] && w[1] == other.w[1];}
+	bool operator!=(const PackedState& other) const {return !(*this == other);}
+	bool operator<(const PackedState& other) const {return (w[1] != other.w[1]) ? w[1] < other.w[1] : w[0] < other.w[0];}
+};
+
+struct PackedStateHash {
+	size_t operator()(const PackedState& s) const {
+		uint64_t h = s.w[0] * 0x9E3779B97F4A7C15ull;
+		h ^= (s.w[1] + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2)) * 0xC2B2AE3D27D4EB4Full;
+		return h ^ (h >> 31);
+	}
+};
+
+// Layout of the packed state and the string views used at the API boundary
+class StateEncoding {
+	private:
+		std::vector<std::string> dim_names;
+		std::vector<std::vector<std::string>> dim_labels;
+		std::vector<int> dim_bits, dim_words, dim_shifts;
+		std::vector<uint64_t> dim_masks;
+		std::unordered_map<std::string, int> dim_inds;
+		std::unordered_map<std::string, std::vector<int>> label_groups;
+		int n_words;
+		bool valid;
+	public:
+		StateEncoding();
+		StateEncoding(const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_);
+		bool isValid() const {return valid;}
+		int numWords() const {return n_words;}
+		int numDims() const {return dim_names.size();}
+		int numLabels(int dim) const {return dim_labels[dim].size();}
+		const std::vector<std::string>& getDimNames() const {return dim_names;}
+		const std::vector<std::vector<std::string>>& getDimLabels() const {return dim_labels;}
+		const std::string& getLabel(int dim, uint32_t label_ind) const {return dim_labels[dim][label_ind];}
+
+		void setLabelGroup(const std::string& group, const std::vector<std::string>& group_dim_names);
+		bool hasLabelGroup(const std::string& group) const {return label_groups.find(group) != label_groups.end();}
+		const std::vector<int>& getLabelGroup(const std::string& group) const;
+		int dimIndex(const std::string& dim_name) const;
+		int labelIndex(int dim, const std::string& label) const;
+
+		// Packing, only for a valid encoding
+		uint32_t get(const PackedState& s, int dim) const {return (s.w[dim_words[dim]] >> dim_shifts[dim]) & dim_masks[dim];}
+		void set(PackedState& s, int dim, uint32_t label_ind) const {
+			uint64_t& word = s.w[dim_words[dim]];
+			word = (word & ~(dim_masks[dim] << dim_shifts[dim])) | (static_cast<uint64_t>(label_ind) << dim_shifts[dim]);
+		}
+		// Sets all bits of 'dim' in 'mask'
+		void addToMask(PackedState& mask, int dim) const {mask.w[dim_words[dim]] |= dim_masks[dim] << dim_shifts[dim];}
+
+		// String views
+		bool encode(const std::vector<std::string>& labels, PackedState& s) const;
+		std::vector<std::string> decode(const PackedState& s) const;
+		const std::string& getVar(const PackedState& s, const std::string& dim_name) const;
+		// Same as State::argFindGroup, finds the dimension in 'group' holding 'label'
+		bool argFindGroup(const PackedState& s, const std::string& label, const std::string& group, std::string& dim_name) const;
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<cstdint>
+#include<chrono>
+
+#include "stateEncoding.h"
+#include "compiledCondition.h"
+#include "denseDFA.h"
+#include "bdd.h"
+
+
+// Transition system as BDDs over the bits of the packed states, with a
+// current and a next variable for every bit (interleaved). Each condition
+// becomes a transition relation over both, its argument bindings split into
+// one case per bound dimension, and the relations of an action are joined.
+// Sets of states are stepped through by image computation, so the reachable
+// states are counted without enumerating them, and whether the DFAs can
+// accept at all is decided over sets of TS states per DFA state tuple.
+// Nodes made by a query are dropped after it. Not thread safe
+class SymbolicTS {
+	public:
+		typedef BDDManager::Node Node;
+	private:
+		// A global label id, or the label of a dimension in the current or next state
+		struct Value {
+			int dim; // -1 for a constant
+			bool next;
+			int global;
+		};
+		struct Binding {
+			int dim; // -1 if unbound
+			Value value;
+		};
+		struct Case {
+			Node cond;
+			std::vector<Binding> args;
+		};
+
+		StateEncoding encoding;
+		std::vector<int> dim_offsets; // First bit of each dimension
+		std::vector<int> dim_bits;
+		BDDManager bdd;
+		int current_vars, next_vars; // Variable sets
+		std::vector<CompiledCondition> conditions;
+		std::vector<CompiledCondition> propositions;
+		std::vector<std::string> action_labels;
+		std::vector<Node> relations; // Per action
+		std::vector<std::string> prop_labels;
+		std::vector<Node> prop_sets, prop_complements;
+		Node init_set, reachable_set;
+		size_t max_nodes;
+
+		static int numBits(int n_labels);
+		static int totalBits(const std::vector<std::vector<std::string>>& dim_labels);
+		int varIndex(int dim, int bit, bool next) const {return 2 * (dim_offsets[dim] + bit) + (next ? 1 : 0);}
+		Node labelIs(int dim, bool next, uint32_t label_ind);
+		Node valueIs(const CompiledCondition& cond, int dim, bool next, const Value& value);
+		Node sameLabel(int dim);
+		Node validLabel(int dim, bool next);
+		void opCases(const CompiledCondition& cond, const CompiledCondition::Op& op, bool next, const Case& in, std::vector<Case>& out);
+		void programCases(const CompiledCondition& cond, const CompiledCondition::Program& program, bool next, std::vector<Case>& cases);
+		Node relation(const CompiledCondition& cond);
+		void splitLetters(Node states, const std::vector<const DenseDFA*>& dfas, const std::vector<std::vector<int>>& props, const std::vector<int>& from, std::vector<uint32_t>& letters, int i, int j, std::vector<std::pair<std::vector<int>, Node>>& out);
+	public:
+		SymbolicTS(const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_);
+		void setLabelGroup(const std::string& group, const std::vector<std::string>& group_dim_names);
+		void setConditions(const std::vector<CompiledCondition>& conditions_);
+		void setPropositions(const std::vector<CompiledCondition>& propositions_);
+		// Compiles the conditions, builds the relations and the reachable states
+		bool setInitState(const std::vector<std::string>& init_state_labels);
+		// A query giving up past this many BDD nodes answers conservatively
+		void setNodeLimit(size_t max_nodes_) {max_nodes = max_nodes_;}
+
+		// Successors and predecessors of a set of states
+		Node image(Node states);
+		Node preImage(Node states);
+		double countStates(Node states) const {return bdd.satCount(states, current_vars);}
+		double numReachable() const {return countStates(reachable_set);}
+		size_t numNodes() const {return bdd.size();}
+
+		// False if no path from the initial state ends where every DFA
+		// accepts (the DFAs read the initial state's label first), true
+		// otherwise or if the node limit or the stop time was hit
+		bool canAccept(const std::vector<const DenseDFA*>& dfas, std::chrono::steady_clock::time_point stop_time);
+		void print() const;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include<string>
+#include<vector>
+#include<mutex>
+#include<unordered_map>
+
+#include "state.h"
+#include "stateSpace.h"
+#include "condition.h"
+#include "compactTS.h"
+#include "stateEncoding.h"
+#include "compiledCondition.h"
+#include "workerPool.h"
+
+
+// Breadth first generation of the transition system into a CompactTS. The
+// frontier of each level is expanded in parallel, and node ids are handed out
+// in (frontier position, successor position) order so that the graph is
+// identical to the serial expansion for any number of threads. Successors come
+// from the compiled conditions, or from the string interpreted Conditions
+// over every state of the state space when the reference path is selected
+class TSGenerator {
+	private:
+		// Concurrent dedup table, sharded by key hash
+		struct Entry {
+			uint64_t rank; // Smallest (frontier position, successor position) that discovered the state
+			int depth; // Level the state was discovered in, written once under the shard lock
+			int id; // Only written by the frontier state at 'rank'
+		};
+		struct Shard {
+			std::mutex mtx;
+			std::unordered_map<PackedState, Entry, PackedStateHash> map;
+		};
+		static const int n_shards = 64;
+		std::vector<Shard> shards;
+		Shard& shardOf(const PackedState& key);
+
+		StateSpace* SS;
+		StateEncoding encoding;
+		std::vector<uint64_t> dim_strides;
+		std::vector<CompiledCondition> conditions;
+		std::vector<CompiledCondition> propositions;
+		bool use_reference;
+		WorkerPool* pool;
+
+		// Reference path only: every state of the state space, indexed in
+		// mixed radix by label index
+		std::vector<State> all_states;
+		std::vector<PackedState> all_packed;
+		void enumerateStates();
+		uint64_t radixOf(const PackedState& s) const;
+	public:
+		TSGenerator(StateSpace* SS_, const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_, WorkerPool* pool_);
+		void setLabelGroup(const std::string& group, const std::vector<std::string>& group_dim_names);
+		void setConditions(const std::vector<CompiledCondition>& conditions_);
+		void setPropositions(const std::vector<CompiledCondition>& propositions_);
+		void setReference(bool use_reference_) {use_reference = use_reference_;}
+		bool generate(const std::vector<std::string>& init_state, CompactTS& ts);
+};
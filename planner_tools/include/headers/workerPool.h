@@ -0,0 +1,117 @@
+#pragma once
+#include<vector>
+#include<deque>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<functional>
+#include<atomic>
+
+
+// Persistent pool of worker threads running parallel-for loops. Each worker
+// owns a deque of chunks seeded with a contiguous slice of the range, pops from
+// its front and steals from the back of the other workers once it runs dry
+class WorkerPool {
+	public:
+		typedef std::function<void(int worker, size_t begin, size_t end)> task_t;
+	private:
+		struct ChunkQueue {
+			std::mutex mtx;
+			std::deque<std::pair<size_t, size_t>> chunks;
+		};
+		const int n_workers;
+		std::vector<std::thread> threads;
+		std::vector<ChunkQueue> queues;
+		std::mutex mtx;
+		std::condition_variable start_cv, done_cv;
+		const task_t* task;
+		int generation, n_running;
+		bool shutdown;
+
+		bool popChunk(int worker, std::pair<size_t, size_t>& chunk) {
+			{
+				std::lock_guard<std::mutex> lock(queues[worker].mtx);
+				if (!queues[worker].chunks.empty()) {
+					chunk = queues[worker].chunks.front();
+					queues[worker].chunks.pop_front();
+					return true;
+				}
+			}
+			for (int i=1; i<n_workers; ++i) {
+				ChunkQueue& victim = queues[(worker + i) % n_workers];
+				std::lock_guard<std::mutex> lock(victim.mtx);
+				if (!victim.chunks.empty()) {
+					chunk = victim.chunks.back();
+					victim.chunks.pop_back();
+					return true;
+				}
+			}
+			return false;
+		}
+		void runChunks(int worker) {
+			std::pair<size_t, size_t> chunk;
+			while (popChunk(worker, chunk)) {
+				(*task)(worker, chunk.first, chunk.second);
+			}
+		}
+		void workerLoop(int worker) {
+			int seen_generation = 0;
+			while (true) {
+				{
+					std::unique_lock<std::mutex> lock(mtx);
+					start_cv.wait(lock, [&] {return shutdown || generation != seen_generation;});
+					if (shutdown) {
+						return;
+					}
+					seen_generation = generation;
+				}
+				runChunks(worker);
+				std::lock_guard<std::mutex> lock(mtx);
+				if (--n_running == 0) {
+					done_cv.notify_all();
+				}
+			}
+		}
+	public:
+		WorkerPool(int n_workers_) : n_workers(n_workers_ > 0 ? n_workers_ : 1), queues(n_workers), task(nullptr), generation(0), n_running(0), shutdown(false) {
+			// Worker 0 is the calling thread
+			for (int i=1; i<n_workers; ++i) {
+				threads.emplace_back(&WorkerPool::workerLoop, this, i);
+			}
+		}
+		int size() const {return n_workers;}
+		void parallelFor(size_t n_items, size_t chunk_size, const task_t& task_) {
+			if (n_items == 0) {
+				return;
+			}
+			chunk_size = (chunk_size > 0) ? chunk_size : 1;
+			const size_t per_worker = (n_items + n_workers - 1) / n_workers;
+			for (int w=0; w<n_workers; ++w) {
+				const size_t slice_end = std::min(n_items, (w + 1) * per_worker);
+				for (size_t begin=w * per_worker; begin<slice_end; begin+=chunk_size) {
+					queues[w].chunks.push_back({begin, std::min(slice_end, begin + chunk_size)});
+				}
+			}
+			task = &task_;
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				n_running = n_workers - 1;
+				++generation;
+			}
+			start_cv.notify_all();
+			runChunks(0);
+			std::unique_lock<std::mutex> lock(mtx);
+			done_cv.wait(lock, [&] {return n_running == 0;});
+			task = nullptr;
+		}
+		~WorkerPool() {
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				shutdown = true;
+			}
+			start_cv.notify_all();
+			for (auto& thread : threads) {
+				thread.join();
+			}
+		}
+};
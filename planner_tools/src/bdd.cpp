@@ -0,0 +1,265 @@
+#include<algorithm>
+#include<unordered_map>
+#include<cmath>
+
+#include "bdd.h"
+
+
+const BDDManager::Node BDDManager::zero;
+const BDDManager::Node BDDManager::one;
+
+BDDManager::BDDManager(int n_vars_) : n_vars(n_vars_), cache(cache_size, {UINT32_MAX, 0, 0, 0, 0}), checkpoint_size(2) {
+	nodes.push_back({static_cast<uint32_t>(n_vars), zero, zero});
+	nodes.push_back({static_cast<uint32_t>(n_vars), one, one});
+	unique_table.assign(1024, 0);
+}
+
+size_t BDDManager::hashNode(uint32_t var, Node lo, Node hi) {
+	uint64_t h = (static_cast<uint64_t>(var) * 0x9E3779B97F4A7C15ull) ^ (static_cast<uint64_t>(lo) * 0xC2B2AE3D27D4EB4Full) ^ (static_cast<uint64_t>(hi) * 0x165667B19E3779F9ull);
+	return h ^ (h >> 29);
+}
+
+void BDDManager::growTable(size_t table_size) {
+	unique_table.assign(table_size, 0);
+	const size_t mask = table_size - 1;
+	for (Node n=2; n<nodes.size(); ++n) {
+		size_t slot = hashNode(nodes[n].var, nodes[n].lo, nodes[n].hi) & mask;
+		while (unique_table[slot] != 0) {
+			slot = (slot + 1) & mask;
+		}
+		unique_table[slot] = n;
+	}
+}
+
+BDDManager::Node BDDManager::makeNode(uint32_t var, Node lo, Node hi) {
+	if (lo == hi) {
+		return lo;
+	}
+	if (2 * (nodes.size() + 1) > unique_table.size()) {
+		growTable(2 * unique_table.size());
+	}
+	const size_t mask = unique_table.size() - 1;
+	size_t slot = hashNode(var, lo, hi) & mask;
+	while (unique_table[slot] != 0) {
+		const NodeData& node = nodes[unique_table[slot]];
+		if (node.var == var && node.lo == lo && node.hi == hi) {
+			return unique_table[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+	unique_table[slot] = nodes.size();
+	nodes.push_back({var, lo, hi});
+	return nodes.size() - 1;
+}
+
+bool BDDManager::cacheLookup(uint32_t op, Node a, Node b, Node c, Node& result) const {
+	const CacheEntry& entry = cache[hashNode(op ^ (c << 4), a, b) & (cache_size - 1)];
+	if (entry.op == op && entry.a == a && entry.b == b && entry.c == c) {
+		result = entry.result;
+		return true;
+	}
+	return false;
+}
+
+void BDDManager::cacheStore(uint32_t op, Node a, Node b, Node c, Node result) {
+	cache[hashNode(op ^ (c << 4), a, b) & (cache_size - 1)] = {op, a, b, c, result};
+}
+
+BDDManager::Node BDDManager::apply(OpCode op, Node a, Node b) {
+	switch (op) {
+		case AND:
+			if (a == zero || b == zero) {
+				return zero;
+			}
+			if (a == one || a == b) {
+				return b;
+			}
+			if (b == one) {
+				return a;
+			}
+			break;
+		case OR:
+			if (a == one || b == one) {
+				return one;
+			}
+			if (a == zero || a == b) {
+				return b;
+			}
+			if (b == zero) {
+				return a;
+			}
+			break;
+		case XOR:
+			if (a == b) {
+				return zero;
+			}
+			if (a == zero) {
+				return b;
+			}
+			if (b == zero) {
+				return a;
+			}
+			break;
+		default:
+			break;
+	}
+	if (a > b) {
+		std::swap(a, b);
+	}
+	Node result;
+	if (cacheLookup(op, a, b, 0, result)) {
+		return result;
+	}
+	const uint32_t v = std::min(nodes[a].var, nodes[b].var);
+	const Node a_lo = (nodes[a].var == v) ? nodes[a].lo : a;
+	const Node a_hi = (nodes[a].var == v) ? nodes[a].hi : a;
+	const Node b_lo = (nodes[b].var == v) ? nodes[b].lo : b;
+	const Node b_hi = (nodes[b].var == v) ? nodes[b].hi : b;
+	const Node lo = apply(op, a_lo, b_lo);
+	const Node hi = apply(op, a_hi, b_hi);
+	result = makeNode(v, lo, hi);
+	cacheStore(op, a, b, 0, result);
+	return result;
+}
+
+int BDDManager::addVarSet(const std::vector<char>& in_set) {
+	var_sets.push_back(in_set);
+	var_sets.back().resize(n_vars, 0);
+	return var_sets.size() - 1;
+}
+
+BDDManager::Node BDDManager::exists(Node f, int var_set) {
+	if (f == zero || f == one) {
+		return f;
+	}
+	Node result;
+	if (cacheLookup(EXISTS, f, 0, var_set, result)) {
+		return result;
+	}
+	const NodeData node = nodes[f];
+	const Node lo = exists(node.lo, var_set);
+	if (var_sets[var_set][node.var] && lo == one) {
+		result = one;
+	} else {
+		const Node hi = exists(node.hi, var_set);
+		result = var_sets[var_set][node.var] ? bddOr(lo, hi) : makeNode(node.var, lo, hi);
+	}
+	cacheStore(EXISTS, f, 0, var_set, result);
+	return result;
+}
+
+BDDManager::Node BDDManager::andExists(Node f, Node g, int var_set) {
+	if (f == zero || g == zero) {
+		return zero;
+	}
+	if (f == one || f == g) {
+		return exists(g, var_set);
+	}
+	if (g == one) {
+		return exists(f, var_set);
+	}
+	if (f > g) {
+		std::swap(f, g);
+	}
+	Node result;
+	if (cacheLookup(AND_EXISTS, f, g, var_set, result)) {
+		return result;
+	}
+	const uint32_t v = std::min(nodes[f].var, nodes[g].var);
+	const Node f_lo = (nodes[f].var == v) ? nodes[f].lo : f;
+	const Node f_hi = (nodes[f].var == v) ? nodes[f].hi : f;
+	const Node g_lo = (nodes[g].var == v) ? nodes[g].lo : g;
+	const Node g_hi = (nodes[g].var == v) ? nodes[g].hi : g;
+	const Node lo = andExists(f_lo, g_lo, var_set);
+	if (var_sets[var_set][v] && lo == one) {
+		result = one;
+	} else {
+		const Node hi = andExists(f_hi, g_hi, var_set);
+		result = var_sets[var_set][v] ? bddOr(lo, hi) : makeNode(v, lo, hi);
+	}
+	cacheStore(AND_EXISTS, f, g, var_set, result);
+	return result;
+}
+
+BDDManager::Node BDDManager::shift(Node f, int delta) {
+	if (f == zero || f == one) {
+		return f;
+	}
+	Node result;
+	if (cacheLookup(SHIFT, f, 0, static_cast<uint32_t>(delta), result)) {
+		return result;
+	}
+	const NodeData node = nodes[f];
+	const Node lo = shift(node.lo, delta);
+	const Node hi = shift(node.hi, delta);
+	result = makeNode(node.var + delta, lo, hi);
+	cacheStore(SHIFT, f, 0, static_cast<uint32_t>(delta), result);
+	return result;
+}
+
+// Assignments to the set variables at or below the level of f
+double BDDManager::countBelow(Node f, const std::vector<int>& n_below, std::unordered_map<Node, double>& counts) const {
+	if (f == zero || f == one) {
+		return (f == one) ? 1.0 : 0.0;
+	}
+	auto it = counts.find(f);
+	if (it != counts.end()) {
+		return it->second;
+	}
+	const NodeData& node = nodes[f];
+	const double c = countBelow(node.lo, n_below, counts) * std::ldexp(1.0, n_below[node.var + 1] - n_below[nodes[node.lo].var])
+		+ countBelow(node.hi, n_below, counts) * std::ldexp(1.0, n_below[node.var + 1] - n_below[nodes[node.hi].var]);
+	counts[f] = c;
+	return c;
+}
+
+double BDDManager::satCount(Node f, int var_set) const {
+	// Variables of the set at or below each level
+	std::vector<int> n_below(n_vars + 1, 0);
+	for (int v=n_vars-1; v>=0; --v) {
+		n_below[v] = n_below[v + 1] + (var_sets[var_set][v] ? 1 : 0);
+	}
+	std::unordered_map<Node, double> counts;
+	return countBelow(f, n_below, counts) * std::ldexp(1.0, n_below[0] - n_below[nodes[f].var]);
+}
+
+void BDDManager::rollback() {
+	nodes.resize(checkpoint_size);
+	growTable(unique_table.size());
+	std::fill(cache.begin(), cache.end(), CacheEntry{UINT32_MAX, 0, 0, 0, 0});
+}
+
+void BDDManager::collect(const std::vector<Node*>& roots) {
+	// Children are always made before their parents
+	std::vector<Node> new_ids(nodes.size(), 0);
+	new_ids[one] = 1;
+	for (auto root : roots) {
+		new_ids[*root] = 1;
+	}
+	for (Node n=nodes.size()-1; n>=2; --n) {
+		if (new_ids[n] != 0) {
+			new_ids[nodes[n].lo] = 1;
+			new_ids[nodes[n].hi] = 1;
+		}
+	}
+	new_ids[zero] = zero;
+	Node n_kept = 2;
+	for (Node n=2; n<nodes.size(); ++n) {
+		if (new_ids[n] != 0) {
+			new_ids[n] = n_kept;
+			nodes[n_kept++] = {nodes[n].var, new_ids[nodes[n].lo], new_ids[nodes[n].hi]};
+		}
+	}
+	nodes.resize(n_kept);
+	nodes.shrink_to_fit();
+	for (auto root : roots) {
+		*root = new_ids[*root];
+	}
+	size_t table_size = 1024;
+	while (table_size < 2 * nodes.size()) {
+		table_size *= 2;
+	}
+	growTable(table_size);
+	std::fill(cache.begin(), cache.end(), CacheEntry{UINT32_MAX, 0, 0, 0, 0});
+	checkpoint_size = nodes.size();
+}
@@ -0,0 +1,347 @@
+#include<iostream>
+#include<fstream>
+#include<sstream>
+#include<algorithm>
+#include<cstring>
+#include<cstdio>
+#include<climits>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+
+#include "compactTS.h"
+
+
+CompactTS::CompactTS() :
+	n_states(0),
+	n_edges(0),
+	prop_words(0),
+	init_state(0),
+	states(nullptr),
+	edge_offsets(nullptr),
+	edge_targets(nullptr),
+	edge_actions(nullptr),
+	action_costs(nullptr),
+	prop_bits(nullptr),
+	mapped(nullptr),
+	mapped_size(0) {}
+
+CompactTS::~CompactTS() {
+	unmap();
+}
+
+void CompactTS::unmap() {
+	if (mapped) {
+		munmap(mapped, mapped_size);
+		mapped = nullptr;
+		mapped_size = 0;
+	}
+}
+
+void CompactTS::setOwnedViews() {
+	states = states_owned.data();
+	edge_offsets = edge_offsets_owned.data();
+	edge_targets = edge_targets_owned.data();
+	edge_actions = edge_actions_owned.data();
+	action_costs = action_costs_owned.data();
+	prop_bits = prop_bits_owned.data();
+}
+
+bool CompactTS::setDimensions(const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_) {
+	encoding = StateEncoding(dim_names_, dim_labels_);
+	return encoding.isValid();
+}
+
+void CompactTS::setPropositionLabels(const std::vector<std::string>& prop_labels_) {
+	prop_labels = prop_labels_;
+	prop_words = (prop_labels.size() + 63) / 64;
+}
+
+int CompactTS::internAction(const std::string& action_label, float cost) {
+	auto it = std::find(action_labels.begin(), action_labels.end(), action_label);
+	if (it != action_labels.end()) {
+		return it - action_labels.begin();
+	}
+	action_labels.push_back(action_label);
+	action_costs_owned.push_back(cost);
+	action_costs = action_costs_owned.data();
+	return action_labels.size() - 1;
+}
+
+void CompactTS::assign(std::vector<uint64_t>&& states_, std::vector<uint32_t>&& edge_offsets_, std::vector<uint32_t>&& edge_targets_, std::vector<action_t>&& edge_actions_, std::vector<uint64_t>&& prop_bits_, int init_state_) {
+	unmap();
+	states_owned = std::move(states_);
+	edge_offsets_owned = std::move(edge_offsets_);
+	edge_targets_owned = std::move(edge_targets_);
+	edge_actions_owned = std::move(edge_actions_);
+	prop_bits_owned = std::move(prop_bits_);
+	n_states = edge_offsets_owned.size() - 1;
+	n_edges = edge_targets_owned.size();
+	init_state = init_state_;
+	setOwnedViews();
+}
+
+bool CompactTS::build(TS_EVAL<State>& ts, const std::vector<SimpleCondition*>& propositions) {
+	if (!encoding.isValid()) {
+		std::cout<<"Error (CompactTS): State space can not be packed"<<std::endl;
+		return false;
+	}
+	const int n_words = encoding.numWords();
+	const int n = ts.size();
+	std::vector<uint64_t> states_(n * n_words);
+	std::vector<uint32_t> edge_offsets_(1, 0);
+	std::vector<uint32_t> edge_targets_;
+	std::vector<action_t> edge_actions_;
+	std::vector<uint64_t> prop_bits_(n * prop_words, 0);
+	for (int i=0; i<n; ++i) {
+		const State* state = ts.getState(i);
+		PackedState packed;
+		for (int d=0; d<encoding.numDims(); ++d) {
+			const std::string var = state->getVar(encoding.getDimNames()[d]);
+			const int label_ind = encoding.labelIndex(d, var);
+			if (label_ind < 0) {
+				std::cout<<"Error (CompactTS): Label '"<<var<<"' is not in dimension '"<<encoding.getDimNames()[d]<<"'"<<std::endl;
+				return false;
+			}
+			encoding.set(packed, d, label_ind);
+		}
+		for (int w=0; w<n_words; ++w) {
+			states_[i * n_words + w] = packed.w[w];
+		}
+		std::vector<int> con_nodes;
+		std::vector<TS_EVAL<State>::WL*> con_data;
+		ts.getConnectedNodes(i, con_nodes);
+		ts.getConnectedData(i, con_data);
+		for (int j=0; j<con_nodes.size(); ++j) {
+			edge_targets_.push_back(con_nodes[j]);
+			edge_actions_.push_back(internAction(con_data[j]->label, con_data[j]->weight));
+		}
+		edge_offsets_.push_back(edge_targets_.size());
+		for (int p=0; p<propositions.size(); ++p) {
+			if (propositions[p]->evaluate(state)) {
+				prop_bits_[i * prop_words + p / 64] |= 1ull << (p % 64);
+			}
+		}
+	}
+	assign(std::move(states_), std::move(edge_offsets_), std::move(edge_targets_), std::move(edge_actions_), std::move(prop_bits_), ts.getInitStateInd());
+	return true;
+}
+
+void CompactTS::restore(TS_EVAL<State>& ts, StateSpace* SS, std::deque<State>& states) const {
+	ts.clearTS();
+	states.clear();
+	for (int i=0; i<n_states; ++i) {
+		states.emplace_back(SS);
+		states.back().setState(getStateLabels(i));
+		ts.addState(&states.back());
+	}
+	for (int i=0; i<n_states; ++i) {
+		for (uint32_t e=edgeBegin(i); e<edgeEnd(i); ++e) {
+			ts.connect(i, edgeTarget(e), actionCost(edgeAction(e)), actionLabel(edgeAction(e)));
+		}
+	}
+}
+
+std::vector<std::string> CompactTS::getStateLabels(int state) const {
+	return encoding.decode(getState(state));
+}
+
+std::string CompactTS::stringTable() const {
+	const std::vector<std::string>& dim_names = encoding.getDimNames();
+	const std::vector<std::vector<std::string>>& dim_labels = encoding.getDimLabels();
+	std::stringstream ss;
+	for (int d=0; d<dim_names.size(); ++d) {
+		ss<<dim_names[d]<<"\n"<<dim_labels[d].size()<<"\n";
+		for (auto& label : dim_labels[d]) {
+			ss<<label<<"\n";
+		}
+	}
+	for (auto& label : action_labels) {
+		ss<<label<<"\n";
+	}
+	for (auto& label : prop_labels) {
+		ss<<label<<"\n";
+	}
+	return ss.str();
+}
+
+bool CompactTS::parseStringTable(const std::string& table, uint32_t n_dims, uint32_t n_actions, uint32_t n_props) {
+	std::stringstream ss(table);
+	std::vector<std::string> dim_names_(n_dims);
+	std::vector<std::vector<std::string>> dim_labels_(n_dims);
+	for (int d=0; d<n_dims; ++d) {
+		std::string n_labels;
+		if (!std::getline(ss, dim_names_[d]) || !std::getline(ss, n_labels)) {
+			return false;
+		}
+		dim_labels_[d].resize(std::stoi(n_labels));
+		for (auto& label : dim_labels_[d]) {
+			std::getline(ss, label);
+		}
+	}
+	// A snapshot of a different state space layout is unusable
+	if (encoding.numDims() > 0 && (dim_names_ != encoding.getDimNames() || dim_labels_ != encoding.getDimLabels())) {
+		return false;
+	}
+	encoding = StateEncoding(dim_names_, dim_labels_);
+	if (!encoding.isValid()) {
+		return false;
+	}
+	action_labels.resize(n_actions);
+	for (auto& label : action_labels) {
+		std::getline(ss, label);
+	}
+	std::vector<std::string> prop_labels_(n_props);
+	for (auto& label : prop_labels_) {
+		std::getline(ss, label);
+	}
+	setPropositionLabels(prop_labels_);
+	return !ss.fail();
+}
+
+bool CompactTS::save(const std::string& filename, uint64_t key) const {
+	auto align = [](uint64_t offset) {return (offset + 7) & ~7ull;};
+	const std::string table = stringTable();
+	SnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "MITSSNAP", 8);
+	header.version = snapshot_version;
+	header.n_states = n_states;
+	header.n_edges = n_edges;
+	header.n_dims = encoding.numDims();
+	header.n_words = encoding.numWords();
+	header.n_actions = action_labels.size();
+	header.n_props = prop_labels.size();
+	header.prop_words = prop_words;
+	header.init_state = init_state;
+	header.key = key;
+	header.strings_offset = sizeof(SnapshotHeader);
+	header.strings_size = table.size();
+	header.states_offset = align(header.strings_offset + header.strings_size);
+	header.edge_offsets_offset = align(header.states_offset + n_states * encoding.numWords() * sizeof(uint64_t));
+	header.edge_targets_offset = align(header.edge_offsets_offset + (n_states + 1) * sizeof(uint32_t));
+	header.edge_actions_offset = align(header.edge_targets_offset + n_edges * sizeof(uint32_t));
+	header.action_costs_offset = align(header.edge_actions_offset + n_edges * sizeof(action_t));
+	header.prop_bits_offset = align(header.action_costs_offset + action_labels.size() * sizeof(float));
+	header.file_size = header.prop_bits_offset + n_states * prop_words * sizeof(uint64_t);
+
+	std::vector<char> buffer(header.file_size, 0);
+	memcpy(buffer.data(), &header, sizeof(header));
+	memcpy(buffer.data() + header.strings_offset, table.data(), table.size());
+	memcpy(buffer.data() + header.states_offset, states, n_states * encoding.numWords() * sizeof(uint64_t));
+	memcpy(buffer.data() + header.edge_offsets_offset, edge_offsets, (n_states + 1) * sizeof(uint32_t));
+	memcpy(buffer.data() + header.edge_targets_offset, edge_targets, n_edges * sizeof(uint32_t));
+	memcpy(buffer.data() + header.edge_actions_offset, edge_actions, n_edges * sizeof(action_t));
+	memcpy(buffer.data() + header.action_costs_offset, action_costs, action_labels.size() * sizeof(float));
+	memcpy(buffer.data() + header.prop_bits_offset, prop_bits, n_states * prop_words * sizeof(uint64_t));
+
+	// Write next to the destination and rename so that readers never map a partial file
+	const std::string tmp_filename = filename + ".tmp";
+	std::ofstream file(tmp_filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout<<"Error (CompactTS): Could not open "<<tmp_filename<<std::endl;
+		return false;
+	}
+	file.write(buffer.data(), buffer.size());
+	file.close();
+	if (file.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+		std::cout<<"Error (CompactTS): Could not write "<<filename<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool CompactTS::validSnapshot(const SnapshotHeader& header, const char* base, uint64_t file_size) {
+	// 'n' elements of 'size' bytes at 'offset', without overflowing
+	auto inFile = [&](uint64_t offset, uint64_t n, uint64_t size, uint64_t alignment) {
+		return offset % alignment == 0 && offset <= file_size && n <= (file_size - offset) / size;
+	};
+	if (header.n_words < 1 || header.n_words > 2 || header.n_states > INT_MAX || header.n_edges > INT_MAX || header.prop_words != (header.n_props + 63) / 64) {
+		return false;
+	}
+	if (!inFile(header.strings_offset, header.strings_size, 1, 1) ||
+		!inFile(header.states_offset, static_cast<uint64_t>(header.n_states) * header.n_words, sizeof(uint64_t), alignof(uint64_t)) ||
+		!inFile(header.edge_offsets_offset, static_cast<uint64_t>(header.n_states) + 1, sizeof(uint32_t), alignof(uint32_t)) ||
+		!inFile(header.edge_targets_offset, header.n_edges, sizeof(uint32_t), alignof(uint32_t)) ||
+		!inFile(header.edge_actions_offset, header.n_edges, sizeof(action_t), alignof(action_t)) ||
+		!inFile(header.action_costs_offset, header.n_actions, sizeof(float), alignof(float)) ||
+		!inFile(header.prop_bits_offset, static_cast<uint64_t>(header.n_states) * header.prop_words, sizeof(uint64_t), alignof(uint64_t))) {
+		return false;
+	}
+	if (header.n_states > 0 && header.init_state >= header.n_states) {
+		return false;
+	}
+	const uint32_t* edge_offsets = reinterpret_cast<const uint32_t*>(base + header.edge_offsets_offset);
+	if (edge_offsets[0] != 0 || edge_offsets[header.n_states] != header.n_edges) {
+		return false;
+	}
+	for (uint32_t s=0; s<header.n_states; ++s) {
+		if (edge_offsets[s] > edge_offsets[s + 1]) {
+			return false;
+		}
+	}
+	const uint32_t* edge_targets = reinterpret_cast<const uint32_t*>(base + header.edge_targets_offset);
+	const action_t* edge_actions = reinterpret_cast<const action_t*>(base + header.edge_actions_offset);
+	for (uint32_t e=0; e<header.n_edges; ++e) {
+		if (edge_targets[e] >= header.n_states || edge_actions[e] >= header.n_actions) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CompactTS::map(const std::string& filename, uint64_t key) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size < sizeof(SnapshotHeader)) {
+		close(fd);
+		return false;
+	}
+	void* region = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (region == MAP_FAILED) {
+		return false;
+	}
+	const char* base = static_cast<const char*>(region);
+	SnapshotHeader header;
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, "MITSSNAP", 8) != 0 || header.version != snapshot_version || header.key != key || header.file_size != file_stat.st_size) {
+		std::cout<<"TS snapshot "<<filename<<" is stale, ignoring it"<<std::endl;
+		munmap(region, file_stat.st_size);
+		return false;
+	}
+	if (!validSnapshot(header, base, file_stat.st_size)) {
+		std::cout<<"TS snapshot "<<filename<<" is corrupt, ignoring it"<<std::endl;
+		munmap(region, file_stat.st_size);
+		return false;
+	}
+	if (!parseStringTable(std::string(base + header.strings_offset, header.strings_size), header.n_dims, header.n_actions, header.n_props) || header.n_words != encoding.numWords()) {
+		std::cout<<"TS snapshot "<<filename<<" does not match the state space, ignoring it"<<std::endl;
+		munmap(region, file_stat.st_size);
+		return false;
+	}
+	unmap();
+	mapped = region;
+	mapped_size = file_stat.st_size;
+	n_states = header.n_states;
+	n_edges = header.n_edges;
+	init_state = header.init_state;
+	states = reinterpret_cast<const uint64_t*>(base + header.states_offset);
+	edge_offsets = reinterpret_cast<const uint32_t*>(base + header.edge_offsets_offset);
+	edge_targets = reinterpret_cast<const uint32_t*>(base + header.edge_targets_offset);
+	edge_actions = reinterpret_cast<const action_t*>(base + header.edge_actions_offset);
+	// Action costs are copied so that more actions can be interned later
+	const float* mapped_action_costs = reinterpret_cast<const float*>(base + header.action_costs_offset);
+	action_costs_owned.assign(mapped_action_costs, mapped_action_costs + header.n_actions);
+	action_costs = action_costs_owned.data();
+	prop_bits = reinterpret_cast<const uint64_t*>(base + header.prop_bits_offset);
+	return true;
+}
+
+void CompactTS::print() const {
+	std::cout<<"Compact TS: "<<n_states<<" states, "<<n_edges<<" edges, "<<prop_labels.size()<<" propositions"<<(mapped ? " (mapped)" : "")<<std::endl;
+}
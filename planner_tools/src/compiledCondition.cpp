@@ -0,0 +1,377 @@
+#include<iostream>
+#include<algorithm>
+
+#include "compiledCondition.h"
+
+
+CompiledCondition::CompiledCondition() :
+	pre_junct_set(false),
+	post_junct_set(false),
+	simple_junct_set(false),
+	action_cost(0.0f),
+	encoding(nullptr),
+	compiled(false) {}
+
+void CompiledCondition::addCondition(cond_t pos, cond_t type, const std::string& label_, cond_t op, cond_t value_type, const std::string& value) {
+	sub_conditions.push_back({pos, type, label_, op, value_type, value, false, Condition::TRUE, ""});
+	compiled = false;
+}
+
+void CompiledCondition::addCondition(cond_t pos, cond_t type, const std::string& label_, cond_t op, cond_t value_type, const std::string& value, cond_t negate, const std::string& arg) {
+	sub_conditions.push_back({pos, type, label_, op, value_type, value, true, negate, arg});
+	compiled = false;
+}
+
+void CompiledCondition::setCondJunctType(cond_t pos, cond_t junct) {
+	if (pos == Condition::PRE) {
+		pre_junct = junct;
+		pre_junct_set = true;
+	} else if (pos == Condition::POST) {
+		post_junct = junct;
+		post_junct_set = true;
+	} else {
+		simple_junct = junct;
+		simple_junct_set = true;
+	}
+	compiled = false;
+}
+
+void CompiledCondition::exportCondition(Condition& cond) const {
+	for (auto& sub : sub_conditions) {
+		if (sub.has_arg) {
+			cond.addCondition(sub.pos, sub.type, sub.label, sub.op, sub.value_type, sub.value, sub.negate, sub.arg);
+		} else {
+			cond.addCondition(sub.pos, sub.type, sub.label, sub.op, sub.value_type, sub.value);
+		}
+	}
+	if (pre_junct_set) {
+		cond.setCondJunctType(Condition::PRE, pre_junct);
+	}
+	if (post_junct_set) {
+		cond.setCondJunctType(Condition::POST, post_junct);
+	}
+	if (simple_junct_set) {
+		cond.setCondJunctType(Condition::SIMPLE, simple_junct);
+	}
+	cond.setActionLabel(action_label);
+	cond.setActionCost(action_cost);
+}
+
+void CompiledCondition::exportCondition(SimpleCondition& cond) const {
+	exportCondition(static_cast<Condition&>(cond));
+	cond.setLabel(label);
+}
+
+bool CompiledCondition::compileSub(const SubCondition& sub, std::vector<std::string>& global_labels, Op& op) {
+	auto globalLabel = [&](const std::string& value) -> int {
+		auto it = std::find(global_labels.begin(), global_labels.end(), value);
+		if (it != global_labels.end()) {
+			return it - global_labels.begin();
+		}
+		// A value that no dimension holds never matches
+		global_labels.push_back(value);
+		return global_labels.size() - 1;
+	};
+	auto argSlot = [&](const std::string& arg) -> int {
+		if (!sub.has_arg) {
+			return -1;
+		}
+		auto it = std::find(arg_names.begin(), arg_names.end(), arg);
+		if (it != arg_names.end()) {
+			return it - arg_names.begin();
+		}
+		arg_names.push_back(arg);
+		return arg_names.size() - 1;
+	};
+	op.negate = sub.has_arg && sub.negate == Condition::NEGATE;
+	op.dim = -1;
+	op.dim_2 = -1;
+	op.value = -1;
+	op.arg = argSlot(sub.arg);
+	op.group = -1;
+	if (sub.value_type == Condition::VAR) {
+		op.value = globalLabel(sub.value);
+	} else if (sub.value_type == Condition::LABEL) {
+		op.dim_2 = encoding->dimIndex(sub.value);
+		if (op.dim_2 < 0) {
+			std::cout<<"Error (CompiledCondition): Unknown label '"<<sub.value<<"'"<<std::endl;
+			return false;
+		}
+	}
+	if (sub.type == Condition::LABEL) {
+		op.dim = encoding->dimIndex(sub.label);
+		if (op.dim < 0) {
+			std::cout<<"Error (CompiledCondition): Unknown label '"<<sub.label<<"'"<<std::endl;
+			return false;
+		}
+		if (sub.op == Condition::EQUALS && sub.value_type == Condition::VAR) {
+			op.code = LABEL_EQUALS_VAR;
+		} else if (sub.op == Condition::EQUALS && sub.value_type == Condition::LABEL) {
+			op.code = LABEL_EQUALS_LABEL;
+		} else if (sub.op == Condition::ARG_FIND && sub.value_type == Condition::NONE) {
+			op.code = LABEL_ARG_FIND;
+		} else {
+			return false;
+		}
+	} else if (sub.type == Condition::GROUP) {
+		if (!encoding->hasLabelGroup(sub.label)) {
+			std::cout<<"Error (CompiledCondition): Unknown label group '"<<sub.label<<"'"<<std::endl;
+			return false;
+		}
+		op.group = groups.size();
+		groups.push_back(encoding->getLabelGroup(sub.label));
+		if (sub.op == Condition::ARG_FIND && sub.value_type == Condition::VAR) {
+			op.code = GROUP_ARG_FIND_VAR;
+		} else if (sub.op == Condition::ARG_FIND && sub.value_type == Condition::LABEL) {
+			op.code = GROUP_ARG_FIND_LABEL;
+		} else {
+			return false;
+		}
+	} else if (sub.type == Condition::ARG_L && sub.op == Condition::ARG_EQUALS && op.arg >= 0) {
+		if (sub.value_type == Condition::VAR) {
+			op.code = ARG_L_EQUALS_VAR;
+		} else if (sub.value_type == Condition::LABEL) {
+			op.code = ARG_L_EQUALS_LABEL;
+		} else {
+			return false;
+		}
+	} else if (sub.type == Condition::ARG_V && sub.op == Condition::ARG_EQUALS && op.arg >= 0) {
+		if (sub.value_type == Condition::VAR) {
+			op.code = ARG_V_EQUALS_VAR;
+		} else if (sub.value_type == Condition::LABEL) {
+			op.code = ARG_V_EQUALS_LABEL;
+		} else {
+			return false;
+		}
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool CompiledCondition::compile(const StateEncoding& encoding_) {
+	encoding = &encoding_;
+	compiled = false;
+	label_ids.assign(encoding->numDims(), {});
+	groups.clear();
+	arg_names.clear();
+	pre_program = {{}, pre_junct_set && pre_junct == Condition::DISJUNCTION};
+	post_program = {{}, post_junct_set && post_junct == Condition::DISJUNCTION};
+	simple_program = {{}, simple_junct_set && simple_junct == Condition::DISJUNCTION};
+	written_dims.clear();
+	written_args.clear();
+
+	// Labels are compared across dimensions by string, so every label string gets one global id
+	std::vector<std::string> global_labels;
+	for (int d=0; d<encoding->numDims(); ++d) {
+		for (auto& dim_label : encoding->getDimLabels()[d]) {
+			auto it = std::find(global_labels.begin(), global_labels.end(), dim_label);
+			label_ids[d].push_back(it - global_labels.begin());
+			if (it == global_labels.end()) {
+				global_labels.push_back(dim_label);
+			}
+		}
+	}
+	for (auto& sub : sub_conditions) {
+		Op op;
+		if (!compileSub(sub, global_labels, op)) {
+			std::cout<<"Error (CompiledCondition): Unsupported sub-condition on '"<<sub.label<<"' in '"<<action_label<<label<<"'"<<std::endl;
+			return false;
+		}
+		if (sub.pos == Condition::PRE) {
+			pre_program.ops.push_back(op);
+		} else if (sub.pos == Condition::POST) {
+			post_program.ops.push_back(op);
+			// Same exclusion as the interpreter: the condition label of a post
+			// sub-condition (or the post label an ARG_V is compared to) may change
+			if (op.code == LABEL_EQUALS_VAR || op.code == LABEL_EQUALS_LABEL || op.code == LABEL_ARG_FIND) {
+				written_dims.push_back(op.dim);
+			} else if (op.code == ARG_V_EQUALS_LABEL) {
+				written_dims.push_back(op.dim_2);
+			} else if (op.code == ARG_L_EQUALS_VAR || op.code == ARG_L_EQUALS_LABEL) {
+				written_args.push_back(op.arg);
+			}
+		} else {
+			simple_program.ops.push_back(op);
+		}
+	}
+	std::sort(written_dims.begin(), written_dims.end());
+	written_dims.erase(std::unique(written_dims.begin(), written_dims.end()), written_dims.end());
+	compiled = true;
+	return true;
+}
+
+bool CompiledCondition::runOp(const Op& op, const PackedState& s, Binding* args) const {
+	bool result = false;
+	switch (op.code) {
+		case LABEL_EQUALS_VAR:
+			result = globalId(s, op.dim) == op.value;
+			break;
+		case LABEL_EQUALS_LABEL:
+			result = globalId(s, op.dim) == globalId(s, op.dim_2);
+			break;
+		case LABEL_ARG_FIND:
+			if (!op.negate && op.arg >= 0) {
+				args[op.arg] = {op.dim, globalId(s, op.dim)};
+			}
+			return !op.negate;
+		case GROUP_ARG_FIND_VAR:
+		case GROUP_ARG_FIND_LABEL: {
+			const int target = (op.code == GROUP_ARG_FIND_VAR) ? op.value : globalId(s, op.dim_2);
+			for (auto d : groups[op.group]) {
+				if (globalId(s, d) == target) {
+					if (!op.negate && op.arg >= 0) {
+						args[op.arg] = {d, target};
+					}
+					return !op.negate;
+				}
+			}
+			return op.negate;
+		}
+		case ARG_L_EQUALS_VAR:
+			if (args[op.arg].dim < 0) {
+				return false;
+			}
+			result = globalId(s, args[op.arg].dim) == op.value;
+			break;
+		case ARG_L_EQUALS_LABEL:
+			if (args[op.arg].dim < 0) {
+				return false;
+			}
+			result = globalId(s, args[op.arg].dim) == globalId(s, op.dim_2);
+			break;
+		case ARG_V_EQUALS_VAR:
+			if (args[op.arg].dim < 0) {
+				return false;
+			}
+			result = args[op.arg].value == op.value;
+			break;
+		case ARG_V_EQUALS_LABEL:
+			if (args[op.arg].dim < 0) {
+				return false;
+			}
+			result = args[op.arg].value == globalId(s, op.dim_2);
+			break;
+	}
+	return result != op.negate;
+}
+
+bool CompiledCondition::run(const Program& program, const PackedState& s, Binding* args) const {
+	for (auto& op : program.ops) {
+		if (runOp(op, s, args) == program.disjunction) {
+			return program.disjunction;
+		}
+	}
+	return !program.disjunction || program.ops.empty();
+}
+
+PackedState CompiledCondition::writeMask(const Binding* args) const {
+	PackedState mask;
+	for (auto d : written_dims) {
+		encoding->addToMask(mask, d);
+	}
+	for (auto arg : written_args) {
+		if (args[arg].dim >= 0) {
+			encoding->addToMask(mask, args[arg].dim);
+		}
+	}
+	return mask;
+}
+
+bool CompiledCondition::evaluatePre(const PackedState& pre, Binding* args) const {
+	for (int i=0; i<arg_names.size(); ++i) {
+		args[i] = {-1, -1};
+	}
+	return run(pre_program, pre, args);
+}
+
+bool CompiledCondition::evaluatePost(const PackedState& pre, const PackedState& post, Binding* args) const {
+	const PackedState mask = writeMask(args);
+	for (int i=0; i<2; ++i) {
+		if ((pre.w[i] ^ post.w[i]) & ~mask.w[i]) {
+			return false;
+		}
+	}
+	return run(post_program, post, args);
+}
+
+bool CompiledCondition::evaluate(const PackedState& pre, const PackedState& post) const {
+	std::vector<Binding> args(arg_names.size());
+	return evaluatePre(pre, args.data()) && evaluatePost(pre, post, args.data());
+}
+
+void CompiledCondition::successors(const PackedState& pre, std::vector<PackedState>& posts) const {
+	std::vector<Binding> args(arg_names.size());
+	if (!evaluatePre(pre, args.data())) {
+		return;
+	}
+	// Only the written dimensions can differ from the pre state
+	std::vector<int> dims = written_dims;
+	for (auto arg : written_args) {
+		if (args[arg].dim < 0) {
+			return;
+		}
+		dims.push_back(args[arg].dim);
+	}
+	std::sort(dims.begin(), dims.end());
+	dims.erase(std::unique(dims.begin(), dims.end()), dims.end());
+
+	std::vector<uint32_t> label_inds(dims.size(), 0);
+	std::vector<Binding> post_args(arg_names.size());
+	PackedState post = pre;
+	while (true) {
+		for (int i=0; i<dims.size(); ++i) {
+			encoding->set(post, dims[i], label_inds[i]);
+		}
+		post_args = args;
+		if (run(post_program, post, post_args.data())) {
+			posts.push_back(post);
+		}
+		int i = 0;
+		while (i < dims.size() && ++label_inds[i] == encoding->numLabels(dims[i])) {
+			label_inds[i] = 0;
+			++i;
+		}
+		if (i == dims.size()) {
+			break;
+		}
+	}
+}
+
+void CompiledCondition::orderedSuccessors(const std::vector<CompiledCondition>& conditions, const PackedState& pre, std::vector<Transition>& transitions) {
+	struct Candidate {
+		uint64_t radix;
+		int k;
+		PackedState post;
+		bool operator<(const Candidate& other) const {return (radix != other.radix) ? radix < other.radix : k < other.k;}
+	};
+	transitions.clear();
+	if (conditions.empty()) {
+		return;
+	}
+	const StateEncoding& encoding = *conditions[0].encoding;
+	std::vector<Candidate> candidates;
+	std::vector<PackedState> posts;
+	for (int k=0; k<conditions.size(); ++k) {
+		posts.clear();
+		conditions[k].successors(pre, posts);
+		for (auto& post : posts) {
+			uint64_t radix = 0;
+			for (int d=0; d<encoding.numDims(); ++d) {
+				radix = radix * encoding.numLabels(d) + encoding.get(post, d);
+			}
+			candidates.push_back({radix, k, post});
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+	for (int i=0; i<candidates.size(); ++i) {
+		if (i == 0 || candidates[i].radix != candidates[i - 1].radix) {
+			transitions.push_back({candidates[i].post, candidates[i].k});
+		}
+	}
+}
+
+bool CompiledCondition::evaluate(const PackedState& state) const {
+	std::vector<Binding> args(arg_names.size(), {-1, -1});
+	return run(simple_program, state, args.data());
+}
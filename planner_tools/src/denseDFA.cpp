@@ -0,0 +1,455 @@
+#include<iostream>
+#include<map>
+#include<algorithm>
+#include<cctype>
+
+#include "denseDFA.h"
+#include "hashUtils.h"
+
+
+const int DenseDFA::unreachable;
+
+DenseDFA::DenseDFA() : n_states(0), n_letters(1), init_state(0) {}
+
+void DenseDFA::resize(const std::vector<std::string>& ap_, int n_states_) {
+	ap = ap_;
+	n_states = n_states_;
+	n_letters = 1 << ap.size();
+	accepting.assign(n_states, false);
+	table.assign(n_states * n_letters, 0);
+}
+
+void DenseDFA::setInitState(int init_state_) {
+	init_state = init_state_;
+}
+
+void DenseDFA::setAccepting(int state, bool accepting_) {
+	accepting[state] = accepting_;
+}
+
+void DenseDFA::setTransition(int state, unsigned letter, int next_state) {
+	table[state * n_letters + letter] = next_state;
+}
+
+void DenseDFA::computeAcceptDistances() {
+	std::vector<std::vector<int>> predecessors(n_states);
+	for (int q=0; q<n_states; ++q) {
+		for (int letter=0; letter<n_letters; ++letter) {
+			std::vector<int>& preds = predecessors[step(q, letter)];
+			if (preds.empty() || preds.back() != q) {
+				preds.push_back(q);
+			}
+		}
+	}
+	accept_dist.assign(n_states, unreachable);
+	std::vector<int> queue;
+	for (int q=0; q<n_states; ++q) {
+		if (accepting[q]) {
+			accept_dist[q] = 0;
+			queue.push_back(q);
+		}
+	}
+	for (int i=0; i<queue.size(); ++i) {
+		for (auto pred : predecessors[queue[i]]) {
+			if (accept_dist[pred] == unreachable) {
+				accept_dist[pred] = accept_dist[queue[i]] + 1;
+				queue.push_back(pred);
+			}
+		}
+	}
+}
+
+// Hopcroft's partition refinement over the states reachable from the initial
+// state, which is state 0 afterwards. The states that can not reach
+// acceptance are equivalent, so at most one dead state is left
+void DenseDFA::minimize() {
+	// Reachable states, in breadth first order
+	std::vector<int> ids(n_states, -1);
+	std::vector<int> order = {init_state};
+	ids[init_state] = 0;
+	for (int i=0; i<order.size(); ++i) {
+		for (int letter=0; letter<n_letters; ++letter) {
+			const int next = step(order[i], letter);
+			if (ids[next] < 0) {
+				ids[next] = order.size();
+				order.push_back(next);
+			}
+		}
+	}
+	const int n = order.size();
+
+	// Predecessors of each state by each letter, at [pred_begin[letter * n + state], pred_begin[letter * n + state + 1])
+	std::vector<int> pred_begin(n_letters * n + 1, 0);
+	std::vector<int> preds(n * n_letters);
+	for (int q=0; q<n; ++q) {
+		for (int letter=0; letter<n_letters; ++letter) {
+			++pred_begin[letter * n + ids[step(order[q], letter)] + 1];
+		}
+	}
+	for (int i=0; i<n_letters * n; ++i) {
+		pred_begin[i + 1] += pred_begin[i];
+	}
+	std::vector<int> pred_end(pred_begin.begin(), pred_begin.end() - 1);
+	for (int q=0; q<n; ++q) {
+		for (int letter=0; letter<n_letters; ++letter) {
+			preds[pred_end[letter * n + ids[step(order[q], letter)]]++] = q;
+		}
+	}
+
+	// Blocks are contiguous ranges of 'elements', accepting states first
+	std::vector<int> elements(n), position(n), block_of(n);
+	std::vector<int> block_begin, block_end, n_marked;
+	int n_accepting = 0;
+	for (int q=0; q<n; ++q) {
+		if (accepting[order[q]]) {
+			elements[n_accepting++] = q;
+		}
+	}
+	for (int q=0, j=n_accepting; q<n; ++q) {
+		if (!accepting[order[q]]) {
+			elements[j++] = q;
+		}
+	}
+	for (int j=0; j<n; ++j) {
+		position[elements[j]] = j;
+	}
+	std::vector<std::pair<int, int>> splitters; // (block, letter)
+	std::vector<char> pending; // Per block and letter, in 'splitters'
+	auto addBlock = [&](int begin, int end) {
+		block_begin.push_back(begin);
+		block_end.push_back(end);
+		n_marked.push_back(0);
+		pending.resize(block_begin.size() * n_letters, 0);
+		for (int j=begin; j<end; ++j) {
+			block_of[elements[j]] = block_begin.size() - 1;
+		}
+	};
+	auto addSplitter = [&](int block, int letter) {
+		pending[block * n_letters + letter] = 1;
+		splitters.push_back({block, letter});
+	};
+	if (n_accepting == 0 || n_accepting == n) {
+		addBlock(0, n);
+	} else {
+		addBlock(0, n_accepting);
+		addBlock(n_accepting, n);
+		const int smaller = (n_accepting <= n - n_accepting) ? 0 : 1;
+		for (int letter=0; letter<n_letters; ++letter) {
+			addSplitter(smaller, letter);
+		}
+	}
+
+	std::vector<int> marked, touched;
+	while (!splitters.empty()) {
+		const int splitter = splitters.back().first;
+		const int letter = splitters.back().second;
+		splitters.pop_back();
+		pending[splitter * n_letters + letter] = 0;
+
+		// Move the predecessors to the front of their blocks
+		marked.clear();
+		for (int j=block_begin[splitter]; j<block_end[splitter]; ++j) {
+			const int q = elements[j];
+			marked.insert(marked.end(), preds.begin() + pred_begin[letter * n + q], preds.begin() + pred_begin[letter * n + q + 1]);
+		}
+		touched.clear();
+		for (auto p : marked) {
+			const int b = block_of[p];
+			const int front = block_begin[b] + n_marked[b];
+			if (position[p] < front) {
+				continue;
+			}
+			if (n_marked[b] == 0) {
+				touched.push_back(b);
+			}
+			const int other = elements[front];
+			std::swap(elements[position[p]], elements[front]);
+			position[other] = position[p];
+			position[p] = front;
+			++n_marked[b];
+		}
+
+		// The marked part of a block becomes a new block
+		for (auto b : touched) {
+			const int split = block_begin[b] + n_marked[b];
+			n_marked[b] = 0;
+			if (split == block_end[b]) {
+				continue;
+			}
+			const int new_block = block_begin.size();
+			addBlock(block_begin[b], split);
+			block_begin[b] = split;
+			const bool new_smaller = (split - block_begin[new_block]) <= (block_end[b] - block_begin[b]);
+			for (int l=0; l<n_letters; ++l) {
+				if (pending[b * n_letters + l] || new_smaller) {
+					addSplitter(new_block, l);
+				} else {
+					addSplitter(b, l);
+				}
+			}
+		}
+	}
+
+	// One state per block, numbered by their first reachable state
+	const int n_blocks = block_begin.size();
+	std::vector<int> block_ids(n_blocks, -1), reps;
+	for (int q=0; q<n; ++q) {
+		if (block_ids[block_of[q]] < 0) {
+			block_ids[block_of[q]] = reps.size();
+			reps.push_back(order[q]);
+		}
+	}
+	std::vector<int> new_table(n_blocks * n_letters);
+	std::vector<char> new_accepting(n_blocks);
+	for (int b=0; b<n_blocks; ++b) {
+		new_accepting[b] = accepting[reps[b]];
+		for (int letter=0; letter<n_letters; ++letter) {
+			new_table[b * n_letters + letter] = block_ids[block_of[ids[step(reps[b], letter)]]];
+		}
+	}
+	n_states = n_blocks;
+	init_state = 0;
+	table.swap(new_table);
+	accepting.swap(new_accepting);
+	accept_dist.clear();
+}
+
+// Transition guards are propositional formulas over the atomic propositions
+// (e.g. "!a & b | c", "1"), parsed into a small expression tree
+struct GuardNode {
+	char op; // 'p' proposition, '1' true, '0' false, '!', '&', '|'
+	int ap;
+	int lhs, rhs;
+};
+
+class GuardParser {
+	private:
+		const std::string& guard;
+		size_t i;
+		std::vector<GuardNode>& nodes;
+		std::vector<std::string>& ap;
+		void skip() {
+			while (i < guard.size() && isspace(guard[i])) {
+				++i;
+			}
+		}
+		int add(char op, int ap_ind, int lhs, int rhs) {
+			nodes.push_back({op, ap_ind, lhs, rhs});
+			return nodes.size() - 1;
+		}
+		int parseOr() {
+			int lhs = parseAnd();
+			skip();
+			while (lhs >= 0 && i < guard.size() && guard[i] == '|') {
+				i += (guard.compare(i, 2, "||") == 0) ? 2 : 1;
+				int rhs = parseAnd();
+				lhs = (rhs < 0) ? -1 : add('|', -1, lhs, rhs);
+				skip();
+			}
+			return lhs;
+		}
+		int parseAnd() {
+			int lhs = parseUnary();
+			skip();
+			while (lhs >= 0 && i < guard.size() && guard[i] == '&') {
+				i += (guard.compare(i, 2, "&&") == 0) ? 2 : 1;
+				int rhs = parseUnary();
+				lhs = (rhs < 0) ? -1 : add('&', -1, lhs, rhs);
+				skip();
+			}
+			return lhs;
+		}
+		int parseUnary() {
+			skip();
+			if (i >= guard.size()) {
+				return -1;
+			}
+			if (guard[i] == '!' || guard[i] == '~') {
+				++i;
+				int arg = parseUnary();
+				return (arg < 0) ? -1 : add('!', -1, arg, -1);
+			}
+			if (guard[i] == '(') {
+				++i;
+				int arg = parseOr();
+				skip();
+				if (arg < 0 || i >= guard.size() || guard[i] != ')') {
+					return -1;
+				}
+				++i;
+				return arg;
+			}
+			size_t begin = i;
+			while (i < guard.size() && (isalnum(guard[i]) || guard[i] == '_')) {
+				++i;
+			}
+			const std::string token = guard.substr(begin, i - begin);
+			if (token.empty()) {
+				return -1;
+			}
+			if (token == "1" || token == "true") {
+				return add('1', -1, -1, -1);
+			}
+			if (token == "0" || token == "false") {
+				return add('0', -1, -1, -1);
+			}
+			auto it = std::find(ap.begin(), ap.end(), token);
+			if (it == ap.end()) {
+				ap.push_back(token);
+				it = ap.end() - 1;
+			}
+			return add('p', it - ap.begin(), -1, -1);
+		}
+	public:
+		GuardParser(const std::string& guard_, std::vector<GuardNode>& nodes_, std::vector<std::string>& ap_) : guard(guard_), i(0), nodes(nodes_), ap(ap_) {}
+		int parse() {
+			int root = parseOr();
+			skip();
+			return (i == guard.size()) ? root : -1;
+		}
+};
+
+static bool evalGuard(const std::vector<GuardNode>& nodes, int node, unsigned letter) {
+	const GuardNode& n = nodes[node];
+	switch (n.op) {
+		case 'p': return (letter >> n.ap) & 1u;
+		case '1': return true;
+		case '0': return false;
+		case '!': return !evalGuard(nodes, n.lhs, letter);
+		case '&': return evalGuard(nodes, n.lhs, letter) && evalGuard(nodes, n.rhs, letter);
+		default: return evalGuard(nodes, n.lhs, letter) || evalGuard(nodes, n.rhs, letter);
+	}
+}
+
+uint64_t DenseDFA::fingerprint() const {
+	uint64_t hash = fnv1a(&n_states, sizeof(n_states));
+	for (auto& prop : ap) {
+		hash = fnv1a(prop, hash);
+		hash = fnv1a("", 1, hash);
+	}
+	hash = fnv1a(&init_state, sizeof(init_state), hash);
+	hash = fnv1a(accepting.data(), accepting.size(), hash);
+	return fnv1a(table.data(), table.size() * sizeof(int), hash);
+}
+
+bool DenseDFA::compile(DFA& dfa, int max_ap) {
+	struct Guard {
+		int to, root;
+	};
+	std::vector<GuardNode> nodes;
+	std::vector<std::string> ap_;
+	std::vector<std::vector<Guard>> guards(dfa.size());
+	for (int q=0; q<dfa.size(); ++q) {
+		std::vector<int> con_nodes;
+		std::vector<std::string*> con_data;
+		dfa.getConnectedNodes(q, con_nodes);
+		dfa.getConnectedData(q, con_data);
+		for (int j=0; j<con_nodes.size(); ++j) {
+			int root = GuardParser(*con_data[j], nodes, ap_).parse();
+			if (root < 0) {
+				std::cout<<"Error (DenseDFA): Could not parse guard '"<<*con_data[j]<<"'"<<std::endl;
+				return false;
+			}
+			guards[q].push_back({con_nodes[j], root});
+		}
+	}
+	if (ap_.size() > max_ap) {
+		std::cout<<"Error (DenseDFA): "<<ap_.size()<<" propositions exceed the limit of "<<max_ap<<std::endl;
+		return false;
+	}
+	// Letters no guard accepts go to a rejecting sink
+	resize(ap_, dfa.size());
+	int sink = -1;
+	for (int q=0; q<dfa.size(); ++q) {
+		for (unsigned letter=0; letter<n_letters; ++letter) {
+			int next_state = -1;
+			for (auto& g : guards[q]) {
+				if (evalGuard(nodes, g.root, letter)) {
+					next_state = g.to;
+					break;
+				}
+			}
+			if (next_state < 0) {
+				if (sink < 0) {
+					sink = n_states++;
+					table.resize(n_states * n_letters, sink);
+					accepting.push_back(false);
+				}
+				next_state = sink;
+			}
+			setTransition(q, letter, next_state);
+		}
+	}
+	setInitState(dfa.getInitState());
+	for (auto q : *dfa.getAcceptingStates()) {
+		setAccepting(q, true);
+	}
+	return true;
+}
+
+std::string DenseDFA::guardFromLetters(const std::vector<unsigned>& letters) const {
+	if (letters.size() == n_letters) {
+		return "1";
+	}
+	// Disjunction of minterms
+	std::string guard;
+	for (auto letter : letters) {
+		if (!guard.empty()) {
+			guard += " | ";
+		}
+		std::string minterm;
+		for (int i=0; i<ap.size(); ++i) {
+			if (!minterm.empty()) {
+				minterm += " & ";
+			}
+			minterm += ((letter >> i) & 1u) ? ap[i] : "!" + ap[i];
+		}
+		guard += minterm.empty() ? "1" : minterm;
+	}
+	return guard;
+}
+
+void DenseDFA::exportDFA(DFA& dfa) const {
+	std::vector<int> accepting_states;
+	for (int q=0; q<n_states; ++q) {
+		if (accepting[q]) {
+			accepting_states.push_back(q);
+		}
+	}
+	dfa.setAP(ap);
+	dfa.setInitState(init_state);
+	dfa.setAcceptingStates(accepting_states);
+	for (int q=0; q<n_states; ++q) {
+		std::map<int, std::vector<unsigned>> letters_to;
+		for (unsigned letter=0; letter<n_letters; ++letter) {
+			letters_to[step(q, letter)].push_back(letter);
+		}
+		for (auto& to : letters_to) {
+			dfa.connect(q, to.first, guardFromLetters(to.second));
+		}
+	}
+}
+
+void DenseDFA::print() const {
+	std::cout<<"Dense DFA ("<<n_states<<" states, "<<ap.size()<<" propositions, init: "<<init_state<<")"<<std::endl;
+	std::cout<<"  Propositions:";
+	for (auto& p : ap) {
+		std::cout<<" "<<p;
+	}
+	std::cout<<"\n  Accepting:";
+	for (int q=0; q<n_states; ++q) {
+		if (accepting[q]) {
+			std::cout<<" "<<q;
+		}
+	}
+	std::cout<<std::endl;
+	for (int q=0; q<n_states; ++q) {
+		std::map<int, std::vector<unsigned>> letters_to;
+		for (unsigned letter=0; letter<n_letters; ++letter) {
+			letters_to[step(q, letter)].push_back(letter);
+		}
+		for (auto& to : letters_to) {
+			std::cout<<"  "<<q<<" -> "<<to.first<<" : "<<guardFromLetters(to.second)<<std::endl;
+		}
+	}
+}
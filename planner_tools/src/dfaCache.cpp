@@ -0,0 +1,336 @@
+#include<iostream>
+#include<algorithm>
+#include<fstream>
+#include<sstream>
+#include<iomanip>
+#include<cerrno>
+#include<climits>
+#include<csignal>
+#include<thread>
+#include<poll.h>
+#include<unistd.h>
+#include<sys/wait.h>
+#include<sys/socket.h>
+#include<sys/stat.h>
+
+#include "dfaCache.h"
+#include "hashUtils.h"
+
+
+TranslatorWorker::TranslatorWorker(const std::string& python_executable_, const std::string& worker_script_, const std::string& formula2dfa_path_) :
+	python_executable(python_executable_),
+	worker_script(worker_script_),
+	formula2dfa_path(formula2dfa_path_),
+	pid(-1),
+	fd(-1) {}
+
+bool TranslatorWorker::start() {
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+		return false;
+	}
+	pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if (pid == 0) {
+		dup2(fds[1], STDIN_FILENO);
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl(python_executable.c_str(), python_executable.c_str(), worker_script.c_str(), "--formula2dfa_path", formula2dfa_path.c_str(), (char*)nullptr);
+		_exit(127);
+	}
+	close(fds[1]);
+	fd = fds[0];
+	read_buffer.clear();
+	std::cout<<"Started translator worker (pid: "<<pid<<")"<<std::endl;
+	return true;
+}
+
+void TranslatorWorker::stop() {
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	read_buffer.clear();
+	if (pid > 0) {
+		// Closing stdin makes the worker exit its read loop, unless it is
+		// stuck in a translation
+		const auto kill_time = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (waitpid(pid, nullptr, WNOHANG) == 0) {
+			if (std::chrono::steady_clock::now() >= kill_time) {
+				kill();
+				return;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		pid = -1;
+	}
+}
+
+void TranslatorWorker::kill() {
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	read_buffer.clear();
+	if (pid > 0) {
+		::kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+		std::cout<<"Killed translator worker (pid: "<<pid<<")"<<std::endl;
+		pid = -1;
+	}
+}
+
+bool TranslatorWorker::isRunning() const {
+	return pid > 0;
+}
+
+namespace {
+	// Waits for 'events' on 'fd' until 'stop_time'
+	bool waitFor(int fd, short events, TranslatorWorker::time_point stop_time) {
+		while (true) {
+			int timeout = -1;
+			if (stop_time != TranslatorWorker::time_point::max()) {
+				const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(stop_time - std::chrono::steady_clock::now());
+				if (left.count() <= 0) {
+					return false;
+				}
+				timeout = std::min<long long>(left.count() + 1, INT_MAX);
+			}
+			pollfd poll_fd = {fd, events, 0};
+			const int n = poll(&poll_fd, 1, timeout);
+			if (n > 0) {
+				return true;
+			}
+			if (n < 0 && errno != EINTR) {
+				return false;
+			}
+		}
+	}
+}
+
+bool TranslatorWorker::writeAll(const std::string& data, time_point stop_time) {
+	size_t written = 0;
+	while (written < data.size()) {
+		if (!waitFor(fd, POLLOUT, stop_time)) {
+			return false;
+		}
+		const ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		written += n;
+	}
+	return true;
+}
+
+bool TranslatorWorker::readLine(std::string& line, time_point stop_time) {
+	size_t end;
+	while ((end = read_buffer.find('\n')) == std::string::npos) {
+		if (!waitFor(fd, POLLIN, stop_time)) {
+			return false;
+		}
+		char buffer[4096];
+		const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return false;
+		}
+		read_buffer.append(buffer, n);
+	}
+	line = read_buffer.substr(0, end + 1);
+	read_buffer.erase(0, end + 1);
+	return true;
+}
+
+bool TranslatorWorker::translate(const std::string& formula, const std::string& dfa_filename, time_point stop_time) {
+	if (std::chrono::steady_clock::now() >= stop_time) {
+		std::cout<<"Error (TranslatorWorker): Deadline passed before the translation"<<std::endl;
+		return false;
+	}
+	// Try once more with a fresh worker if the connection has broken
+	for (int attempt=0; attempt<2; ++attempt) {
+		if (!isRunning() && !start()) {
+			std::cout<<"Error (TranslatorWorker): Could not start the translator worker"<<std::endl;
+			return false;
+		}
+		std::string reply;
+		if (writeAll(formula + "\t" + dfa_filename + "\n", stop_time) && readLine(reply, stop_time)) {
+			if (reply.compare(0, 2, "ok") == 0) {
+				return true;
+			}
+			std::cout<<"Error (TranslatorWorker): "<<reply;
+			return false;
+		}
+		if (std::chrono::steady_clock::now() >= stop_time) {
+			// Its reply would be taken for the next request's
+			std::cout<<"Error (TranslatorWorker): Translation did not finish before the deadline"<<std::endl;
+			kill();
+			start();
+			return false;
+		}
+		stop();
+	}
+	std::cout<<"Error (TranslatorWorker): Translator worker is not responding"<<std::endl;
+	return false;
+}
+
+TranslatorWorker::~TranslatorWorker() {
+	stop();
+}
+
+
+DFACache::DFACache(const std::string& cache_dir_, LTLfTranslator* native_translator_, TranslatorWorker* worker_) : 
+	cache_dir(cache_dir_), 
+	native_translator(native_translator_),
+	worker(worker_), 
+	hits(0), 
+	native_translations(0),
+	disk_hits(0), 
+	misses(0) {
+	mkdir(cache_dir.c_str(), 0755);
+}
+
+namespace {
+	// Identifier characters, parentheses and operator characters. Two
+	// characters of the same class only join into one token when nothing
+	// separates them ("aUb" is a proposition, "a U b" is not; "[ ]" is not "[]")
+	int charClass(char c) {
+		if (isalnum(static_cast<unsigned char>(c)) || c == '_') {
+			return 0;
+		}
+		return (c == '(' || c == ')') ? 1 : 2;
+	}
+}
+
+std::string DFACache::normalize(const std::string& formula) {
+	// Whitespace is dropped unless it separates two tokens that would
+	// otherwise be read as one, where it becomes a single space
+	std::string key;
+	key.reserve(formula.size());
+	bool separated = false;
+	for (auto c : formula) {
+		if (isspace(static_cast<unsigned char>(c))) {
+			separated = !key.empty();
+			continue;
+		}
+		if (separated && charClass(c) != 1 && charClass(c) == charClass(key.back())) {
+			key.push_back(' ');
+		}
+		key.push_back(c);
+		separated = false;
+	}
+	return key;
+}
+
+std::string DFACache::hashKey(const std::string& key) {
+	std::stringstream ss;
+	ss<<std::hex<<std::setw(16)<<std::setfill('0')<<fnv1a(key);
+	return ss.str();
+}
+
+std::string DFACache::filenameFromKey(const std::string& key, const std::string& extension) const {
+	return cache_dir + "/" + hashKey(key) + extension;
+}
+
+bool DFACache::readFromDisk(const std::string& key, DFA& dfa) const {
+	// The formula is stored next to the dfa file to guard against hash collisions
+	std::ifstream formula_file(filenameFromKey(key, ".formula"));
+	std::string stored_key;
+	if (!formula_file.is_open() || !std::getline(formula_file, stored_key) || stored_key != key) {
+		return false;
+	}
+	return dfa.readFileSingle(filenameFromKey(key, ".txt"));
+}
+
+DFA* DFACache::get(const std::string& formula, TranslatorWorker::time_point stop_time) {
+	const std::string key = normalize(formula);
+	auto it = dfas.find(key);
+	if (it != dfas.end()) {
+		++hits;
+		return &it->second;
+	}
+	DFA& dfa = dfas[key];
+	if (native_translator) {
+		DenseDFA dense_dfa;
+		if (native_translator->translate(formula, dense_dfa)) {
+			++native_translations;
+			dense_dfa.minimize();
+			dense_dfa.exportDFA(dfa);
+			dense_dfa.computeAcceptDistances();
+			dense_dfas[key] = std::move(dense_dfa);
+			return &dfa;
+		}
+		std::cout<<"Native translator declined formula ("<<native_translator->getError()<<"), falling back to the translator worker"<<std::endl;
+	}
+	if (readFromDisk(key, dfa)) {
+		++disk_hits;
+		return &dfa;
+	}
+	++misses;
+	// The worker reads one formula per line
+	std::string worker_formula = formula;
+	std::replace_if(worker_formula.begin(), worker_formula.end(), [](char c) {return isspace(static_cast<unsigned char>(c));}, ' ');
+	if (worker && worker->translate(worker_formula, filenameFromKey(key, ".txt"), stop_time)) {
+		std::ofstream formula_file(filenameFromKey(key, ".formula"));
+		formula_file<<key<<"\n";
+		formula_file.close();
+		if (dfa.readFileSingle(filenameFromKey(key, ".txt"))) {
+			return &dfa;
+		}
+	}
+	std::cout<<"Error (DFACache): Could not translate formula: "<<formula<<std::endl;
+	dfas.erase(key);
+	return nullptr;
+}
+
+DenseDFA* DFACache::getDense(const std::string& formula, TranslatorWorker::time_point stop_time) {
+	const std::string key = normalize(formula);
+	auto it = dense_dfas.find(key);
+	if (it != dense_dfas.end()) {
+		++hits;
+		return &it->second;
+	}
+	if (dense_failures.count(key) > 0) {
+		return nullptr;
+	}
+	// Counts the lookup, and a native translation leaves the dense DFA behind
+	DFA* dfa = get(formula, stop_time);
+	if (!dfa) {
+		return nullptr;
+	}
+	it = dense_dfas.find(key);
+	if (it != dense_dfas.end()) {
+		return &it->second;
+	}
+	DenseDFA& dense_dfa = dense_dfas[key];
+	if (!dense_dfa.compile(*dfa)) {
+		dense_dfas.erase(key);
+		dense_failures.insert(key);
+		return nullptr;
+	}
+	dense_dfa.minimize();
+	dense_dfa.computeAcceptDistances();
+	return &dense_dfa;
+}
+
+bool DFACache::contains(const std::string& formula) const {
+	return dfas.find(normalize(formula)) != dfas.end();
+}
+
+int DFACache::size() const {
+	return dfas.size();
+}
+
+void DFACache::printStats() const {
+	std::cout<<"DFA cache: "<<dfas.size()<<" DFAs (memory hits: "<<hits<<", native: "<<native_translations<<", disk hits: "<<disk_hits<<", worker: "<<misses<<")"<<std::endl;
+}
@@ -0,0 +1,207 @@
+#include<iostream>
+#include<algorithm>
+#include<functional>
+#include<unordered_map>
+#include<cmath>
+
+#include "hierarchicalSearch.h"
+
+
+HierarchicalSearch::HierarchicalSearch(LazyTS* abstract_ts_, const CompactTS* ts_) : abstract_ts(abstract_ts_), ts(ts_), lazy_ts(nullptr), abstract_search(abstract_ts_), stop_time(std::chrono::steady_clock::time_point::max()), success(false), path_length(0.0f), n_abstract_steps(0) {}
+
+HierarchicalSearch::HierarchicalSearch(LazyTS* abstract_ts_, LazyTS* lazy_ts_) : abstract_ts(abstract_ts_), ts(nullptr), lazy_ts(lazy_ts_), abstract_search(abstract_ts_), stop_time(std::chrono::steady_clock::time_point::max()), success(false), path_length(0.0f), n_abstract_steps(0) {}
+
+void HierarchicalSearch::setAutomata(const std::vector<const DenseDFA*>& dfas_) {
+	dfas = dfas_;
+	abstract_search.setAutomata(dfas);
+}
+
+bool HierarchicalSearch::mapDims(const StateEncoding& encoding) {
+	if (!concrete_dims.empty()) {
+		return true;
+	}
+	const StateEncoding& abstract_encoding = abstract_ts->getEncoding();
+	for (int d=0; d<abstract_encoding.numDims(); ++d) {
+		const std::string& dim_name = abstract_encoding.getDimNames()[d];
+		const int dim = encoding.dimIndex(dim_name);
+		if (dim < 0) {
+			std::cout<<"Error (HierarchicalSearch): Abstract dimension "<<dim_name<<" is not in the transition system"<<std::endl;
+			concrete_dims.clear();
+			return false;
+		}
+		concrete_dims.push_back(dim);
+		label_map.emplace_back(encoding.numLabels(dim), -1);
+		for (int l=0; l<encoding.numLabels(dim); ++l) {
+			label_map.back()[l] = abstract_encoding.labelIndex(d, encoding.getLabel(dim, l));
+		}
+	}
+	return true;
+}
+
+// 0 if the concrete state 's' projects onto the abstract state 'a', 1 if onto
+// 'b', -1 otherwise
+int HierarchicalSearch::project(const StateEncoding& encoding, const PackedState& s, const PackedState& a, const PackedState& b) const {
+	const StateEncoding& abstract_encoding = abstract_ts->getEncoding();
+	bool on_a = true, on_b = true;
+	for (int d=0; d<concrete_dims.size() && (on_a || on_b); ++d) {
+		const int label = label_map[d][encoding.get(s, concrete_dims[d])];
+		on_a = on_a && label == static_cast<int>(abstract_encoding.get(a, d));
+		on_b = on_b && label == static_cast<int>(abstract_encoding.get(b, d));
+	}
+	return on_b ? 1 : (on_a ? 0 : -1);
+}
+
+// Cheapest concrete path from 'state' into a state projecting onto 'to',
+// through states projecting onto 'from'. False if there is none or the stop
+// time is reached
+template<class TS>
+bool HierarchicalSearch::refineStep(TS& trans_sys, int& state, const PackedState& from, const PackedState& to) {
+	struct Reached {
+		float dist;
+		int parent;
+		int action;
+	};
+	typedef std::pair<float, int> Entry;
+	const StateEncoding& encoding = trans_sys.getEncoding();
+	std::unordered_map<int, Reached> reached;
+	std::vector<Entry> heap;
+	reached[state] = {0.0f, -1, -1};
+	heap.push_back({0.0f, state});
+	int n_pops = 0;
+	while (!heap.empty()) {
+		if ((++n_pops & 1023) == 0 && stop_time != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > stop_time) {
+			return false;
+		}
+		std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+		const Entry top = heap.back();
+		heap.pop_back();
+		if (top.first > reached[top.second].dist) {
+			continue;
+		}
+		if (project(encoding, trans_sys.getState(top.second), from, to) == 1) {
+			// Walk the edges back to the start of the step
+			std::vector<int> states, actions;
+			for (int s=top.second; s!=state; s=reached[s].parent) {
+				states.push_back(s);
+				actions.push_back(reached[s].action);
+			}
+			state_sequence.insert(state_sequence.end(), states.rbegin(), states.rend());
+			action_sequence.insert(action_sequence.end(), actions.rbegin(), actions.rend());
+			state = top.second;
+			return true;
+		}
+		expand(trans_sys, top.second);
+		for (uint32_t e=trans_sys.edgeBegin(top.second); e<trans_sys.edgeEnd(top.second); ++e) {
+			const int target = trans_sys.edgeTarget(e);
+			if (project(encoding, trans_sys.getState(target), from, to) < 0) {
+				continue;
+			}
+			const float d = top.first + trans_sys.actionCost(trans_sys.edgeAction(e));
+			auto it = reached.find(target);
+			if (it == reached.end() || d < it->second.dist) {
+				reached[target] = {d, top.second, trans_sys.edgeAction(e)};
+				heap.push_back({d, target});
+				std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+			}
+		}
+	}
+	return false;
+}
+
+template<class TS>
+bool HierarchicalSearch::refine(TS& trans_sys) {
+	const std::vector<int>& abstract_states = abstract_search.getStateSequence();
+	int state = trans_sys.getInitState();
+	const PackedState init = abstract_ts->getState(abstract_states[0]);
+	if (project(trans_sys.getEncoding(), trans_sys.getState(state), init, init) != 1) {
+		std::cout<<"Error (HierarchicalSearch): Abstract and concrete initial states differ"<<std::endl;
+		return false;
+	}
+	state_sequence.assign(1, state);
+	action_sequence.clear();
+	for (int k=0; k+1<abstract_states.size(); ++k) {
+		if (!refineStep(trans_sys, state, abstract_ts->getState(abstract_states[k]), abstract_ts->getState(abstract_states[k + 1]))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Runs the DFAs over the refined plan, false unless they all accept with the
+// abstract path length and cost vector
+template<class TS>
+bool HierarchicalSearch::verify(const TS& trans_sys) {
+	const float eps = 1e-4f;
+	const std::vector<std::string>& prop_labels = trans_sys.getPropLabels();
+	path_length = 0.0f;
+	cost_vector.assign(dfas.size(), 0.0f);
+	for (int i=0; i<dfas.size(); ++i) {
+		std::vector<int> props;
+		for (auto& ap : dfas[i]->getAP()) {
+			auto it = std::find(prop_labels.begin(), prop_labels.end(), ap);
+			props.push_back((it != prop_labels.end()) ? it - prop_labels.begin() : -1);
+		}
+		auto letter = [&](int state) {
+			uint32_t l = 0;
+			for (int j=0; j<props.size(); ++j) {
+				if (props[j] >= 0 && trans_sys.hasProp(state, props[j])) {
+					l |= 1u << j;
+				}
+			}
+			return l;
+		};
+		int q = dfas[i]->step(dfas[i]->getInitState(), letter(state_sequence[0]));
+		for (int k=0; k<action_sequence.size(); ++k) {
+			if (!dfas[i]->isAccepting(q)) {
+				cost_vector[i] += trans_sys.actionCost(action_sequence[k]);
+			}
+			q = dfas[i]->step(q, letter(state_sequence[k + 1]));
+		}
+		if (!dfas[i]->isAccepting(q)) {
+			return false;
+		}
+	}
+	for (auto action : action_sequence) {
+		path_length += trans_sys.actionCost(action);
+	}
+	if (std::abs(path_length - abstract_search.getPathLength()) > eps) {
+		return false;
+	}
+	for (int i=0; i<dfas.size(); ++i) {
+		if (std::abs(cost_vector[i] - abstract_search.getCostVector()[i]) > eps) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool HierarchicalSearch::search() {
+	success = false;
+	path_length = 0.0f;
+	cost_vector.clear();
+	state_sequence.clear();
+	action_sequence.clear();
+	n_abstract_steps = 0;
+	if (!mapDims(lazy_ts ? lazy_ts->getEncoding() : ts->getEncoding()) || !abstract_search.search()) {
+		return false;
+	}
+	n_abstract_steps = abstract_search.getActionSequence().size();
+	if (lazy_ts) {
+		success = refine(*lazy_ts) && verify(*lazy_ts);
+	} else {
+		success = refine(*ts) && verify(*ts);
+	}
+	return success;
+}
+
+void HierarchicalSearch::print() const {
+	std::cout<<"Hierarchical search: "<<(success ? "refined plan" : "no refined plan")<<" (abstract states: "<<abstract_ts->size()<<", abstract steps: "<<n_abstract_steps<<", concrete steps: "<<action_sequence.size()<<")"<<std::endl;
+	if (!success) {
+		return;
+	}
+	std::cout<<"  Path length: "<<path_length<<"\n  Cost vector:";
+	for (auto c_i : cost_vector) {
+		std::cout<<" "<<c_i;
+	}
+	std::cout<<std::endl;
+}
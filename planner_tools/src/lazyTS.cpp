@@ -0,0 +1,111 @@
+#include<iostream>
+#include<algorithm>
+
+#include "lazyTS.h"
+
+
+const uint32_t LazyTS::unexpanded;
+
+LazyTS::LazyTS(const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_) :
+	encoding(dim_names_, dim_labels_),
+	prop_words(0),
+	init_state(0),
+	n_expanded(0) {}
+
+void LazyTS::setLabelGroup(const std::string& group, const std::vector<std::string>& group_dim_names) {
+	encoding.setLabelGroup(group, group_dim_names);
+}
+
+void LazyTS::setConditions(const std::vector<CompiledCondition>& conditions_) {
+	conditions = conditions_;
+}
+
+void LazyTS::setPropositions(const std::vector<CompiledCondition>& propositions_) {
+	propositions = propositions_;
+}
+
+bool LazyTS::setInitState(const std::vector<std::string>& init_state_labels) {
+	PackedState init_key;
+	if (!encoding.isValid() || !encoding.encode(init_state_labels, init_key)) {
+		std::cout<<"Error (LazyTS): Initial state is not in the state space"<<std::endl;
+		return false;
+	}
+	for (auto& cond : conditions) {
+		if (!cond.compile(encoding)) {
+			return false;
+		}
+	}
+	for (auto& prop : propositions) {
+		if (!prop.compile(encoding)) {
+			return false;
+		}
+	}
+	action_labels.clear();
+	action_costs.clear();
+	action_inds.resize(conditions.size());
+	for (int k=0; k<conditions.size(); ++k) {
+		auto it = std::find(action_labels.begin(), action_labels.end(), conditions[k].getActionLabel());
+		if (it == action_labels.end()) {
+			action_labels.push_back(conditions[k].getActionLabel());
+			action_costs.push_back(conditions[k].getActionCost());
+			it = action_labels.end() - 1;
+		}
+		action_inds[k] = it - action_labels.begin();
+	}
+	prop_labels.clear();
+	for (auto& prop : propositions) {
+		prop_labels.push_back(prop.getLabel());
+	}
+	prop_words = (propositions.size() + 63) / 64;
+
+	ids.clear();
+	states.clear();
+	prop_bits.clear();
+	edge_begin.clear();
+	edge_end.clear();
+	edge_targets.clear();
+	edge_actions.clear();
+	n_expanded = 0;
+	init_state = internState(init_key);
+	return true;
+}
+
+int LazyTS::internState(const PackedState& s) {
+	auto it = ids.find(s);
+	if (it != ids.end()) {
+		return it->second;
+	}
+	const int id = edge_begin.size();
+	ids[s] = id;
+	for (int w=0; w<encoding.numWords(); ++w) {
+		states.push_back(s.w[w]);
+	}
+	prop_bits.resize((id + 1) * prop_words, 0);
+	for (int p=0; p<propositions.size(); ++p) {
+		if (propositions[p].evaluate(s)) {
+			prop_bits[id * prop_words + p / 64] |= 1ull << (p % 64);
+		}
+	}
+	edge_begin.push_back(unexpanded);
+	edge_end.push_back(unexpanded);
+	return id;
+}
+
+void LazyTS::expandState(int state) {
+	// Same (post state, condition) order as TSGenerator
+	std::vector<CompiledCondition::Transition> transitions;
+	CompiledCondition::orderedSuccessors(conditions, getState(state), transitions);
+	const uint32_t begin = edge_targets.size();
+	for (auto& transition : transitions) {
+		const int target = internState(transition.post);
+		edge_targets.push_back(target);
+		edge_actions.push_back(action_inds[transition.condition]);
+	}
+	edge_begin[state] = begin;
+	edge_end[state] = edge_targets.size();
+	++n_expanded;
+}
+
+void LazyTS::print() const {
+	std::cout<<"Lazy TS: "<<size()<<" states discovered, "<<n_expanded<<" expanded, "<<edge_targets.size()<<" edges, "<<prop_labels.size()<<" propositions"<<std::endl;
+}
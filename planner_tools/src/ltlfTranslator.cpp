@@ -0,0 +1,344 @@
+#include<iostream>
+#include<algorithm>
+#include<map>
+#include<queue>
+
+#include "ltlfTranslator.h"
+
+
+LTLfTranslator::LTLfTranslator(int max_ap_, int max_states_) : max_ap(max_ap_), max_states(max_states_), tok_i(0) {}
+
+void LTLfTranslator::clear() {
+	raw_nodes.clear();
+	nodes.clear();
+	unique_nodes.clear();
+	prog_memo.clear();
+	ap.clear();
+	tokens.clear();
+	tok_i = 0;
+	error.clear();
+}
+
+bool LTLfTranslator::tokenize(const std::string& formula) {
+	int i = 0;
+	while (i < formula.size()) {
+		char c = formula[i];
+		if (isspace(static_cast<unsigned char>(c))) {
+			++i;
+		} else if (isalnum(static_cast<unsigned char>(c)) || c == '_') {
+			int j = i;
+			while (j < formula.size() && (isalnum(static_cast<unsigned char>(formula[j])) || formula[j] == '_')) {
+				++j;
+			}
+			tokens.push_back(formula.substr(i, j - i));
+			i = j;
+		} else if (formula.compare(i, 2, "->") == 0 || formula.compare(i, 2, "&&") == 0 || formula.compare(i, 2, "||") == 0) {
+			tokens.push_back(formula.substr(i, 2));
+			i += 2;
+		} else if (c == '(' || c == ')' || c == '!' || c == '&' || c == '|') {
+			tokens.push_back(std::string(1, c));
+			++i;
+		} else {
+			error = "Unsupported character '" + std::string(1, c) + "'";
+			return false;
+		}
+	}
+	return true;
+}
+
+int LTLfTranslator::addRaw(char op, int ap_ind, int lhs, int rhs) {
+	raw_nodes.push_back({op, ap_ind, lhs, rhs});
+	return raw_nodes.size() - 1;
+}
+
+int LTLfTranslator::parseImplies() {
+	int lhs = parseOr();
+	if (lhs >= 0 && tok_i < tokens.size() && tokens[tok_i] == "->") {
+		++tok_i;
+		int rhs = parseImplies();
+		if (rhs < 0) {
+			return -1;
+		}
+		// a -> b == !a | b
+		return addRaw('|', -1, addRaw('!', -1, lhs, -1), rhs);
+	}
+	return lhs;
+}
+
+int LTLfTranslator::parseOr() {
+	int lhs = parseAnd();
+	while (lhs >= 0 && tok_i < tokens.size() && (tokens[tok_i] == "|" || tokens[tok_i] == "||")) {
+		++tok_i;
+		int rhs = parseAnd();
+		if (rhs < 0) {
+			return -1;
+		}
+		lhs = addRaw('|', -1, lhs, rhs);
+	}
+	return lhs;
+}
+
+int LTLfTranslator::parseAnd() {
+	int lhs = parseBinaryTemporal();
+	while (lhs >= 0 && tok_i < tokens.size() && (tokens[tok_i] == "&" || tokens[tok_i] == "&&")) {
+		++tok_i;
+		int rhs = parseBinaryTemporal();
+		if (rhs < 0) {
+			return -1;
+		}
+		lhs = addRaw('&', -1, lhs, rhs);
+	}
+	return lhs;
+}
+
+int LTLfTranslator::parseBinaryTemporal() {
+	// Binary temporal operators bind tighter than the boolean ones (as in Spot) and are right associative
+	int lhs = parseUnary();
+	if (lhs >= 0 && tok_i < tokens.size() && (tokens[tok_i] == "U" || tokens[tok_i] == "R")) {
+		char op = tokens[tok_i][0];
+		++tok_i;
+		int rhs = parseBinaryTemporal();
+		if (rhs < 0) {
+			return -1;
+		}
+		return addRaw(op, -1, lhs, rhs);
+	}
+	return lhs;
+}
+
+int LTLfTranslator::parseUnary() {
+	if (tok_i >= tokens.size()) {
+		error = "Unexpected end of formula";
+		return -1;
+	}
+	const std::string& tok = tokens[tok_i++];
+	if (tok == "!" || tok == "X" || tok == "F" || tok == "G") {
+		int arg = parseUnary();
+		return (arg < 0) ? -1 : addRaw(tok[0], -1, arg, -1);
+	} else if (tok == "(") {
+		int arg = parseImplies();
+		if (arg < 0) {
+			return -1;
+		}
+		if (tok_i >= tokens.size() || tokens[tok_i] != ")") {
+			error = "Missing ')'";
+			return -1;
+		}
+		++tok_i;
+		return arg;
+	} else if (tok == "true" || tok == "1") {
+		return addRaw('1', -1, -1, -1);
+	} else if (tok == "false" || tok == "0") {
+		return addRaw('0', -1, -1, -1);
+	} else if (isalpha(static_cast<unsigned char>(tok[0])) || tok[0] == '_') {
+		if (tok == "U" || tok == "R" || tok == "W" || tok == "M") {
+			error = "Unexpected operator '" + tok + "'";
+			return -1;
+		}
+		auto it = std::find(ap.begin(), ap.end(), tok);
+		int ap_ind = it - ap.begin();
+		if (it == ap.end()) {
+			ap.push_back(tok);
+		}
+		return addRaw('a', ap_ind, -1, -1);
+	}
+	error = "Unexpected token '" + tok + "'";
+	return -1;
+}
+
+int LTLfTranslator::mkNode(Op op, int ap_ind, const std::vector<int>& args) {
+	std::string key = std::to_string(op) + ":" + std::to_string(ap_ind);
+	for (auto arg : args) {
+		key += "," + std::to_string(arg);
+	}
+	auto it = unique_nodes.find(key);
+	if (it != unique_nodes.end()) {
+		return it->second;
+	}
+	nodes.push_back({op, ap_ind, args});
+	unique_nodes[key] = nodes.size() - 1;
+	return nodes.size() - 1;
+}
+
+int LTLfTranslator::mkJunction(Op op, const std::vector<int>& args) {
+	// Flatten, drop units and sort so that equivalent junctions share a node
+	const Op unit = (op == AND) ? TRUE_F : FALSE_F;
+	const Op absorbing = (op == AND) ? FALSE_F : TRUE_F;
+	std::vector<int> flat;
+	for (auto arg : args) {
+		const Node& node = nodes[arg];
+		if (node.op == absorbing) {
+			return mkNode(absorbing, -1, {});
+		} else if (node.op == op) {
+			flat.insert(flat.end(), node.args.begin(), node.args.end());
+		} else if (node.op != unit) {
+			flat.push_back(arg);
+		}
+	}
+	std::sort(flat.begin(), flat.end());
+	flat.erase(std::unique(flat.begin(), flat.end()), flat.end());
+	for (auto arg : flat) {
+		if (nodes[arg].op == AP && std::find(flat.begin(), flat.end(), mkNode(NOT_AP, nodes[arg].ap, {})) != flat.end()) {
+			return mkNode(absorbing, -1, {});
+		}
+	}
+	if (flat.empty()) {
+		return mkNode(unit, -1, {});
+	} else if (flat.size() == 1) {
+		return flat[0];
+	}
+	return mkNode(op, -1, flat);
+}
+
+int LTLfTranslator::nnf(int raw_ind, bool negate) {
+	const RawNode raw = raw_nodes[raw_ind];
+	switch (raw.op) {
+		case '1': return mkNode(negate ? FALSE_F : TRUE_F, -1, {});
+		case '0': return mkNode(negate ? TRUE_F : FALSE_F, -1, {});
+		case 'a': return mkNode(negate ? NOT_AP : AP, raw.ap, {});
+		case '!': return nnf(raw.lhs, !negate);
+		case '&': return mkJunction(negate ? OR : AND, {nnf(raw.lhs, negate), nnf(raw.rhs, negate)});
+		case '|': return mkJunction(negate ? AND : OR, {nnf(raw.lhs, negate), nnf(raw.rhs, negate)});
+		// Over finite traces the dual of (strong) next is weak next
+		case 'X': return mkNode(negate ? WEAK_NEXT : NEXT, -1, {nnf(raw.lhs, negate)});
+		case 'F': return mkNode(negate ? ALWAYS : EVENTUALLY, -1, {nnf(raw.lhs, negate)});
+		case 'G': return mkNode(negate ? EVENTUALLY : ALWAYS, -1, {nnf(raw.lhs, negate)});
+		case 'U': return mkNode(negate ? RELEASE : UNTIL, -1, {nnf(raw.lhs, negate), nnf(raw.rhs, negate)});
+		case 'R': return mkNode(negate ? UNTIL : RELEASE, -1, {nnf(raw.lhs, negate), nnf(raw.rhs, negate)});
+	}
+	return mkNode(FALSE_F, -1, {});
+}
+
+std::pair<int, bool> LTLfTranslator::progress(int node_ind, unsigned letter) {
+	const unsigned long long memo_key = (static_cast<unsigned long long>(node_ind) << 32) | letter;
+	auto it = prog_memo.find(memo_key);
+	if (it != prog_memo.end()) {
+		return it->second;
+	}
+	const Node node = nodes[node_ind];
+	std::pair<int, bool> ret;
+	switch (node.op) {
+		case TRUE_F:
+			ret = {node_ind, true};
+			break;
+		case FALSE_F:
+			ret = {node_ind, false};
+			break;
+		case AP:
+		case NOT_AP: {
+			bool holds = ((letter >> node.ap) & 1u) == (node.op == AP);
+			ret = {mkNode(holds ? TRUE_F : FALSE_F, -1, {}), holds};
+			break;
+		}
+		case AND:
+		case OR: {
+			std::vector<int> progressed;
+			bool last = (node.op == AND);
+			for (auto arg : node.args) {
+				std::pair<int, bool> arg_ret = progress(arg, letter);
+				progressed.push_back(arg_ret.first);
+				last = (node.op == AND) ? (last && arg_ret.second) : (last || arg_ret.second);
+			}
+			ret = {mkJunction(node.op, progressed), last};
+			break;
+		}
+		case NEXT:
+			ret = {node.args[0], false};
+			break;
+		case WEAK_NEXT:
+			ret = {node.args[0], true};
+			break;
+		case EVENTUALLY: {
+			std::pair<int, bool> arg_ret = progress(node.args[0], letter);
+			ret = {mkJunction(OR, {arg_ret.first, node_ind}), arg_ret.second};
+			break;
+		}
+		case ALWAYS: {
+			std::pair<int, bool> arg_ret = progress(node.args[0], letter);
+			ret = {mkJunction(AND, {arg_ret.first, node_ind}), arg_ret.second};
+			break;
+		}
+		case UNTIL: {
+			std::pair<int, bool> lhs_ret = progress(node.args[0], letter);
+			std::pair<int, bool> rhs_ret = progress(node.args[1], letter);
+			ret = {mkJunction(OR, {rhs_ret.first, mkJunction(AND, {lhs_ret.first, node_ind})}), rhs_ret.second};
+			break;
+		}
+		case RELEASE: {
+			std::pair<int, bool> lhs_ret = progress(node.args[0], letter);
+			std::pair<int, bool> rhs_ret = progress(node.args[1], letter);
+			ret = {mkJunction(AND, {rhs_ret.first, mkJunction(OR, {lhs_ret.first, node_ind})}), rhs_ret.second};
+			break;
+		}
+	}
+	prog_memo[memo_key] = ret;
+	return ret;
+}
+
+bool LTLfTranslator::parse(const std::string& formula, std::vector<std::string>& ap_out) {
+	clear();
+	if (!tokenize(formula)) {
+		return false;
+	}
+	if (tokens.empty()) {
+		error = "Empty formula";
+		return false;
+	}
+	int root = parseImplies();
+	if (root < 0) {
+		return false;
+	}
+	if (tok_i != tokens.size()) {
+		error = "Unexpected token '" + tokens[tok_i] + "'";
+		return false;
+	}
+	ap_out = ap;
+	return true;
+}
+
+bool LTLfTranslator::translate(const std::string& formula, DenseDFA& dfa) {
+	std::vector<std::string> formula_ap;
+	if (!parse(formula, formula_ap)) {
+		return false;
+	}
+	if (formula_ap.size() > max_ap) {
+		error = "Too many atomic propositions (" + std::to_string(formula_ap.size()) + ")";
+		return false;
+	}
+	const int root = nnf(raw_nodes.size() - 1, false);
+	const unsigned n_letters = 1u << ap.size();
+
+	// Explore (obligation, satisfied so far) pairs breadth first. The initial
+	// state has read the empty word, which never satisfies the formula
+	std::map<std::pair<int, bool>, int> state_inds;
+	std::vector<std::pair<int, bool>> states;
+	std::vector<std::vector<int>> transitions;
+	state_inds[{root, false}] = 0;
+	states.push_back({root, false});
+	for (int q=0; q<states.size(); ++q) {
+		transitions.emplace_back(n_letters);
+		for (unsigned letter=0; letter<n_letters; ++letter) {
+			std::pair<int, bool> next = progress(states[q].first, letter);
+			auto it = state_inds.find(next);
+			if (it == state_inds.end()) {
+				if (states.size() >= max_states) {
+					error = "Too many DFA states";
+					return false;
+				}
+				it = state_inds.insert({next, states.size()}).first;
+				states.push_back(next);
+			}
+			transitions[q][letter] = it->second;
+		}
+	}
+
+	dfa.resize(ap, states.size());
+	dfa.setInitState(0);
+	for (int q=0; q<states.size(); ++q) {
+		dfa.setAccepting(q, states[q].second);
+		for (unsigned letter=0; letter<n_letters; ++letter) {
+			dfa.setTransition(q, letter, transitions[q][letter]);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,162 @@
+#include<iostream>
+#include<algorithm>
+#include<fstream>
+#include<cstring>
+#include<cstdio>
+#include<unordered_map>
+
+#include "patternDB.h"
+
+
+PatternDB::PatternDB() : n_states(0) {}
+
+bool PatternDB::build(const CompactTS& ts, const std::vector<std::vector<std::string>>& pattern_dim_names) {
+	const StateEncoding& encoding = ts.getEncoding();
+	patterns.assign(pattern_dim_names.size(), Pattern());
+	std::vector<std::vector<uint32_t>> strides(patterns.size());
+	for (int p=0; p<patterns.size(); ++p) {
+		patterns[p].size = 1;
+		for (auto& dim_name : pattern_dim_names[p]) {
+			const int dim = encoding.dimIndex(dim_name);
+			if (dim < 0) {
+				std::cout<<"Error (PatternDB): Unknown dimension: "<<dim_name<<std::endl;
+				patterns.clear();
+				return false;
+			}
+			patterns[p].dims.push_back(dim);
+			strides[p].push_back(patterns[p].size);
+			patterns[p].size *= encoding.numLabels(dim);
+		}
+	}
+
+	n_states = ts.size();
+	pattern_states.resize(n_states * patterns.size());
+	for (int s=0; s<n_states; ++s) {
+		const PackedState state = ts.getState(s);
+		for (int p=0; p<patterns.size(); ++p) {
+			uint32_t pattern_state = 0;
+			for (int j=0; j<patterns[p].dims.size(); ++j) {
+				pattern_state += encoding.get(state, patterns[p].dims[j]) * strides[p][j];
+			}
+			pattern_states[s * patterns.size() + p] = pattern_state;
+		}
+	}
+
+	// Cheapest TS edge between every pair of pattern states. Edges within a
+	// pattern state are kept, the DFAs can still move along them
+	for (int p=0; p<patterns.size(); ++p) {
+		Pattern& pattern = patterns[p];
+		std::unordered_map<uint64_t, float> edges;
+		for (int s=0; s<n_states; ++s) {
+			const uint32_t source = patternState(s, p);
+			for (uint32_t e=ts.edgeBegin(s); e<ts.edgeEnd(s); ++e) {
+				const uint32_t target = patternState(ts.edgeTarget(e), p);
+				const float cost = ts.actionCost(ts.edgeAction(e));
+				auto it = edges.insert({static_cast<uint64_t>(target) * pattern.size + source, cost}).first;
+				it->second = std::min(it->second, cost);
+			}
+		}
+		pattern.in_offsets.assign(pattern.size + 1, 0);
+		for (auto& edge : edges) {
+			++pattern.in_offsets[edge.first / pattern.size + 1];
+		}
+		for (uint32_t a=0; a<pattern.size; ++a) {
+			pattern.in_offsets[a + 1] += pattern.in_offsets[a];
+		}
+		pattern.in_sources.resize(edges.size());
+		pattern.in_costs.resize(edges.size());
+		std::vector<uint32_t> fill(pattern.in_offsets.begin(), pattern.in_offsets.end() - 1);
+		for (auto& edge : edges) {
+			const uint32_t e = fill[edge.first / pattern.size]++;
+			pattern.in_sources[e] = edge.first % pattern.size;
+			pattern.in_costs[e] = edge.second;
+		}
+	}
+	return true;
+}
+
+bool PatternDB::save(const std::string& filename, uint64_t key) const {
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "MITSPDB", 7);
+	header.version = file_version;
+	header.n_states = n_states;
+	header.n_patterns = patterns.size();
+	header.key = key;
+
+	// Write next to the destination and rename so that readers never load a partial file
+	const std::string tmp_filename = filename + ".tmp";
+	std::ofstream file(tmp_filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout<<"Error (PatternDB): Could not open "<<tmp_filename<<std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (auto& pattern : patterns) {
+		const uint32_t n_dims = pattern.dims.size();
+		const uint32_t n_edges = pattern.in_sources.size();
+		file.write(reinterpret_cast<const char*>(&n_dims), sizeof(n_dims));
+		file.write(reinterpret_cast<const char*>(&pattern.size), sizeof(pattern.size));
+		file.write(reinterpret_cast<const char*>(&n_edges), sizeof(n_edges));
+		file.write(reinterpret_cast<const char*>(pattern.dims.data()), n_dims * sizeof(int));
+		file.write(reinterpret_cast<const char*>(pattern.in_offsets.data()), (pattern.size + 1) * sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(pattern.in_sources.data()), n_edges * sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(pattern.in_costs.data()), n_edges * sizeof(float));
+	}
+	file.write(reinterpret_cast<const char*>(pattern_states.data()), pattern_states.size() * sizeof(uint32_t));
+	file.close();
+	if (file.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+		std::cout<<"Error (PatternDB): Could not write "<<filename<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool PatternDB::load(const std::string& filename, uint64_t key, const CompactTS& ts) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	FileHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || memcmp(header.magic, "MITSPDB", 7) != 0 || header.version != file_version || header.key != key || header.n_states != ts.size()) {
+		std::cout<<"Warning (PatternDB): Pattern database "<<filename<<" does not match the transition system, rebuilding"<<std::endl;
+		return false;
+	}
+	std::vector<Pattern> loaded(header.n_patterns);
+	for (auto& pattern : loaded) {
+		uint32_t n_dims = 0, n_edges = 0;
+		file.read(reinterpret_cast<char*>(&n_dims), sizeof(n_dims));
+		file.read(reinterpret_cast<char*>(&pattern.size), sizeof(pattern.size));
+		file.read(reinterpret_cast<char*>(&n_edges), sizeof(n_edges));
+		if (!file) {
+			return false;
+		}
+		pattern.dims.resize(n_dims);
+		pattern.in_offsets.resize(pattern.size + 1);
+		pattern.in_sources.resize(n_edges);
+		pattern.in_costs.resize(n_edges);
+		file.read(reinterpret_cast<char*>(pattern.dims.data()), n_dims * sizeof(int));
+		file.read(reinterpret_cast<char*>(pattern.in_offsets.data()), (pattern.size + 1) * sizeof(uint32_t));
+		file.read(reinterpret_cast<char*>(pattern.in_sources.data()), n_edges * sizeof(uint32_t));
+		file.read(reinterpret_cast<char*>(pattern.in_costs.data()), n_edges * sizeof(float));
+	}
+	std::vector<uint32_t> loaded_states(header.n_states * header.n_patterns);
+	file.read(reinterpret_cast<char*>(loaded_states.data()), loaded_states.size() * sizeof(uint32_t));
+	if (!file) {
+		std::cout<<"Error (PatternDB): Truncated pattern database "<<filename<<std::endl;
+		return false;
+	}
+	patterns = std::move(loaded);
+	pattern_states = std::move(loaded_states);
+	n_states = header.n_states;
+	return true;
+}
+
+void PatternDB::print() const {
+	std::cout<<"Pattern database: "<<patterns.size()<<" patterns over "<<n_states<<" states (sizes:";
+	for (auto& pattern : patterns) {
+		std::cout<<" "<<pattern.size;
+	}
+	std::cout<<")"<<std::endl;
+}
@@ -0,0 +1,209 @@
+#include<iostream>
+#include<fstream>
+#include<sstream>
+#include<iomanip>
+#include<iterator>
+#include<cstring>
+#include<cstdio>
+
+#include "planCache.h"
+#include "hashUtils.h"
+
+
+const uint32_t PlanCache::file_version;
+
+PlanCache::PlanCache(size_t capacity_, const std::string& filename_) : capacity(capacity_), filename(filename_), lookups(0), hits(0), dirty(false) {
+	if (enabled() && !filename.empty()) {
+		load();
+	}
+}
+
+PlanCache::~PlanCache() {
+	flush();
+}
+
+std::string PlanCache::makeKey(uint64_t ts_key, const PackedState& start_state, const std::vector<std::string>& formulas, float flexibility) {
+	// The flexibility by its bits, so that the key does not depend on printing precision
+	uint32_t flexibility_bits;
+	memcpy(&flexibility_bits, &flexibility, sizeof(flexibility_bits));
+	std::stringstream key;
+	key<<std::hex<<std::setw(16)<<std::setfill('0')<<ts_key<<"\n"<<start_state.w[1]<<" "<<start_state.w[0]<<"\n"<<flexibility_bits<<"\n";
+	for (auto& formula : formulas) {
+		key<<formula<<"\n";
+	}
+	return key.str();
+}
+
+const PlanCache::Entry* PlanCache::find(const std::string& key) {
+	if (!enabled()) {
+		return nullptr;
+	}
+	++lookups;
+	auto it = index.find(fnv1a(key));
+	if (it == index.end() || it->second->key != key) {
+		return nullptr;
+	}
+	++hits;
+	lru.splice(lru.begin(), lru, it->second);
+	return &it->second->entry;
+}
+
+void PlanCache::insert(const std::string& key, const Entry& entry) {
+	if (!enabled()) {
+		return;
+	}
+	const uint64_t hash = fnv1a(key);
+	auto it = index.find(hash);
+	if (it != index.end()) {
+		// Same key or a colliding one, either way the newer plan replaces it
+		lru.erase(it->second);
+		index.erase(it);
+	}
+	lru.push_front({hash, key, entry});
+	index[hash] = lru.begin();
+	while (lru.size() > capacity) {
+		index.erase(lru.back().hash);
+		lru.pop_back();
+	}
+	dirty = true;
+}
+
+void PlanCache::clear() {
+	lru.clear();
+	index.clear();
+	dirty = true;
+}
+
+bool PlanCache::flush() {
+	if (!dirty || !enabled() || filename.empty()) {
+		return true;
+	}
+	dirty = !save();
+	return !dirty;
+}
+
+double PlanCache::hitRate() const {
+	return (lookups > 0) ? static_cast<double>(hits) / lookups : 0.0;
+}
+
+void PlanCache::printStats() const {
+	std::cout<<"Plan cache: "<<lru.size()<<" plans (hits: "<<hits<<" of "<<lookups<<" lookups, hit rate: "<<hitRate()<<")"<<std::endl;
+}
+
+namespace {
+	void writeString(std::ofstream& file, const std::string& str) {
+		const uint32_t n = str.size();
+		file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+		file.write(str.data(), n);
+	}
+
+	bool readString(std::ifstream& file, std::string& str) {
+		uint32_t n = 0;
+		file.read(reinterpret_cast<char*>(&n), sizeof(n));
+		if (!file) {
+			return false;
+		}
+		str.resize(n);
+		file.read(&str[0], n);
+		return static_cast<bool>(file);
+	}
+
+	template<class T>
+	void writeVector(std::ofstream& file, const std::vector<T>& vec) {
+		const uint32_t n = vec.size();
+		file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+		file.write(reinterpret_cast<const char*>(vec.data()), n * sizeof(T));
+	}
+
+	template<class T>
+	bool readVector(std::ifstream& file, std::vector<T>& vec) {
+		uint32_t n = 0;
+		file.read(reinterpret_cast<char*>(&n), sizeof(n));
+		if (!file) {
+			return false;
+		}
+		vec.resize(n);
+		file.read(reinterpret_cast<char*>(vec.data()), n * sizeof(T));
+		return static_cast<bool>(file);
+	}
+}
+
+bool PlanCache::save() const {
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "MITSPLC", 7);
+	header.version = file_version;
+	header.n_entries = lru.size();
+
+	// Write next to the destination and rename so that readers never load a partial file
+	const std::string tmp_filename = filename + ".tmp";
+	std::ofstream file(tmp_filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout<<"Error (PlanCache): Could not open "<<tmp_filename<<std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (auto& node : lru) {
+		const Entry& entry = node.entry;
+		const uint8_t success = entry.success;
+		writeString(file, node.key);
+		file.write(reinterpret_cast<const char*>(&success), sizeof(success));
+		file.write(reinterpret_cast<const char*>(&entry.path_length), sizeof(entry.path_length));
+		file.write(reinterpret_cast<const char*>(&entry.suboptimality), sizeof(entry.suboptimality));
+		writeVector(file, entry.cost_vector);
+		writeVector(file, entry.state_sequence);
+		const uint32_t n_actions = entry.action_sequence.size();
+		file.write(reinterpret_cast<const char*>(&n_actions), sizeof(n_actions));
+		for (auto& action : entry.action_sequence) {
+			writeString(file, action);
+		}
+	}
+	file.close();
+	if (file.fail() || rename(tmp_filename.c_str(), filename.c_str()) != 0) {
+		std::cout<<"Error (PlanCache): Could not write "<<filename<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool PlanCache::load() {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	FileHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || memcmp(header.magic, "MITSPLC", 7) != 0 || header.version != file_version) {
+		std::cout<<"Warning (PlanCache): "<<filename<<" is not a plan cache of this version, starting empty"<<std::endl;
+		return false;
+	}
+	// Saved most recent first, so the oldest plans are the ones past the capacity
+	for (uint32_t i=0; i<header.n_entries && lru.size()<capacity; ++i) {
+		Node node;
+		Entry& entry = node.entry;
+		uint8_t success = 0;
+		uint32_t n_actions = 0;
+		bool read = readString(file, node.key);
+		file.read(reinterpret_cast<char*>(&success), sizeof(success));
+		file.read(reinterpret_cast<char*>(&entry.path_length), sizeof(entry.path_length));
+		file.read(reinterpret_cast<char*>(&entry.suboptimality), sizeof(entry.suboptimality));
+		read = read && file && readVector(file, entry.cost_vector) && readVector(file, entry.state_sequence);
+		file.read(reinterpret_cast<char*>(&n_actions), sizeof(n_actions));
+		entry.action_sequence.resize(read && file ? n_actions : 0);
+		for (auto& action : entry.action_sequence) {
+			read = read && readString(file, action);
+		}
+		if (!read || !file) {
+			std::cout<<"Error (PlanCache): Truncated plan cache "<<filename<<", keeping its first "<<lru.size()<<" plans"<<std::endl;
+			break;
+		}
+		entry.success = success;
+		node.hash = fnv1a(node.key);
+		if (index.count(node.hash) == 0) {
+			lru.push_back(std::move(node));
+			index[lru.back().hash] = std::prev(lru.end());
+		}
+	}
+	std::cout<<"Loaded "<<lru.size()<<" plans from "<<filename<<std::endl;
+	return true;
+}
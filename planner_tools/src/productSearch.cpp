@@ -0,0 +1,1075 @@
+#include<iostream>
+#include<algorithm>
+#include<limits>
+#include<functional>
+
+#include "productSearch.h"
+#include "hashUtils.h"
+
+
+ProductSearch::ProductSearch(const CompactTS* ts_) : ts(ts_), lazy_ts(nullptr), flexibility(0.0f), n_dfas(0), stop_time(std::chrono::steady_clock::time_point::max()), weight(1.0f), use_accept_dist(false), min_action_cost(0.0f), pattern_db(nullptr), max_accept_entries(0), has_heuristic(false), reduced(false), sym_failed(false), use_buckets(false), pool(nullptr), parallel_pass(false), success(false), path_length(0.0f), complete(false), suboptimality(1.0f), n_expanded(0) {}
+
+ProductSearch::ProductSearch(LazyTS* lazy_ts_) : ts(nullptr), lazy_ts(lazy_ts_), flexibility(0.0f), n_dfas(0), stop_time(std::chrono::steady_clock::time_point::max()), weight(1.0f), use_accept_dist(false), min_action_cost(0.0f), pattern_db(nullptr), max_accept_entries(0), has_heuristic(false), reduced(false), sym_failed(false), use_buckets(false), pool(nullptr), parallel_pass(false), success(false), path_length(0.0f), complete(false), suboptimality(1.0f), n_expanded(0) {}
+
+void ProductSearch::setAutomata(const std::vector<const DenseDFA*>& dfas_) {
+	dfas = dfas_;
+	n_dfas = dfas.size();
+	letters.clear();
+	use_accept_dist = true;
+	for (auto dfa : dfas) {
+		letters.push_back(lazy_ts ? &letterTable(*lazy_ts, *dfa) : &letterTable(*ts, *dfa));
+		use_accept_dist = use_accept_dist && dfa->hasAcceptDistances();
+	}
+	min_action_cost = lazy_ts ? minActionCost(*lazy_ts) : minActionCost(*ts);
+	computeAcceptTables();
+	computePatternDists();
+	has_heuristic = (use_accept_dist && min_action_cost > 0.0f) || !pattern_dists.empty();
+	for (auto dist : accept_dists) {
+		has_heuristic = has_heuristic || dist;
+	}
+}
+
+void ProductSearch::setInterchangeable(const std::vector<int>& dims) {
+	sym_dims = dims;
+	canon_states.clear();
+}
+
+// Backward Dijkstra over the product of the CompactTS and the DFA from the
+// accepting DFA states. (p, q_p) -> (s, q) when q_p reads the letter of s
+// into q
+bool ProductSearch::acceptTable(const DenseDFA& dfa, const std::vector<uint32_t>& state_letters, std::vector<float>& dist) {
+	if (in_offsets.empty()) {
+		in_offsets.assign(ts->size() + 1, 0);
+		for (int p=0; p<ts->size(); ++p) {
+			for (uint32_t e=ts->edgeBegin(p); e<ts->edgeEnd(p); ++e) {
+				++in_offsets[ts->edgeTarget(e) + 1];
+			}
+		}
+		for (int s=0; s<ts->size(); ++s) {
+			in_offsets[s + 1] += in_offsets[s];
+		}
+		in_sources.resize(ts->numEdges());
+		in_costs.resize(ts->numEdges());
+		std::vector<uint32_t> fill(in_offsets.begin(), in_offsets.end() - 1);
+		for (int p=0; p<ts->size(); ++p) {
+			for (uint32_t e=ts->edgeBegin(p); e<ts->edgeEnd(p); ++e) {
+				const uint32_t slot = fill[ts->edgeTarget(e)]++;
+				in_sources[slot] = p;
+				in_costs[slot] = ts->actionCost(ts->edgeAction(e));
+			}
+		}
+	}
+	// DFA states reading each letter into each state
+	const int n_q = dfa.size();
+	std::vector<int> pred_offsets(dfa.numLetters() * n_q + 1, 0), preds(dfa.numLetters() * n_q);
+	for (int letter=0; letter<dfa.numLetters(); ++letter) {
+		for (int q=0; q<n_q; ++q) {
+			++pred_offsets[letter * n_q + dfa.step(q, letter) + 1];
+		}
+	}
+	for (size_t i=1; i<pred_offsets.size(); ++i) {
+		pred_offsets[i] += pred_offsets[i - 1];
+	}
+	std::vector<int> fill(pred_offsets.begin(), pred_offsets.end() - 1);
+	for (int letter=0; letter<dfa.numLetters(); ++letter) {
+		for (int q=0; q<n_q; ++q) {
+			preds[fill[letter * n_q + dfa.step(q, letter)]++] = q;
+		}
+	}
+
+	// Dial's algorithm when the action costs are integers, as in the search
+	typedef std::pair<float, uint64_t> Entry;
+	std::vector<Entry> heap;
+	BucketQueue buckets;
+	const bool use_dial = integerCosts(*ts);
+	auto push = [&](float d, uint64_t ind) {
+		if (use_dial) {
+			buckets.push(static_cast<size_t>(d), ind);
+		} else {
+			heap.push_back({d, ind});
+			std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+		}
+	};
+	dist.assign(static_cast<size_t>(ts->size()) * n_q, std::numeric_limits<float>::infinity());
+	for (int s=0; s<ts->size(); ++s) {
+		for (int q=0; q<n_q; ++q) {
+			if (dfa.isAccepting(q)) {
+				dist[static_cast<uint64_t>(s) * n_q + q] = 0.0f;
+				push(0.0f, static_cast<uint64_t>(s) * n_q + q);
+			}
+		}
+	}
+	int n_pops = 0;
+	while (use_dial ? !buckets.empty() : !heap.empty()) {
+		if ((++n_pops & 4095) == 0 && pastStopTime()) {
+			return false;
+		}
+		Entry top;
+		if (use_dial) {
+			top.first = buckets.minPriority();
+			top.second = buckets.pop();
+		} else {
+			std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+			top = heap.back();
+			heap.pop_back();
+		}
+		if (top.first > dist[top.second]) {
+			continue;
+		}
+		const int s = top.second / n_q;
+		const int q = top.second % n_q;
+		const int pred_ind = state_letters[s] * n_q + q;
+		for (uint32_t e=in_offsets[s]; e<in_offsets[s + 1]; ++e) {
+			const float d = top.first + in_costs[e];
+			for (int i=pred_offsets[pred_ind]; i<pred_offsets[pred_ind + 1]; ++i) {
+				const uint64_t source = static_cast<uint64_t>(in_sources[e]) * n_q + preds[i];
+				if (d < dist[source]) {
+					dist[source] = d;
+					push(d, source);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+// Looks up the table of each DFA, computing the missing ones. When they do
+// not fit, the tables of DFAs no longer searched with are dropped first
+void ProductSearch::computeAcceptTables() {
+	accept_dists.assign(n_dfas, nullptr);
+	if (max_accept_entries == 0 || lazy_ts) {
+		return;
+	}
+	std::vector<uint64_t> keys(n_dfas);
+	for (int i=0; i<n_dfas; ++i) {
+		keys[i] = dfas[i]->fingerprint();
+	}
+	size_t n_entries = 0;
+	for (auto& table : accept_tables) {
+		n_entries += table.second.size();
+	}
+	for (int i=0; i<n_dfas; ++i) {
+		auto it = accept_tables.find(keys[i]);
+		if (it == accept_tables.end()) {
+			// Entries are queued as ints
+			const size_t table_size = static_cast<size_t>(ts->size()) * dfas[i]->size();
+			if (table_size > static_cast<size_t>(std::numeric_limits<int>::max()) || pastStopTime()) {
+				continue;
+			}
+			for (auto old_it=accept_tables.begin(); old_it!=accept_tables.end() && n_entries + table_size > max_accept_entries; ) {
+				if (std::find(keys.begin(), keys.end(), old_it->first) == keys.end()) {
+					n_entries -= old_it->second.size();
+					old_it = accept_tables.erase(old_it);
+				} else {
+					++old_it;
+				}
+			}
+			if (n_entries + table_size > max_accept_entries) {
+				continue;
+			}
+			it = accept_tables.insert({keys[i], std::vector<float>()}).first;
+			if (!acceptTable(*dfas[i], letters[i]->letters, it->second)) {
+				// Out of time, a partial table is not a bound
+				accept_tables.erase(it);
+				continue;
+			}
+			n_entries += table_size;
+		}
+		accept_dists[i] = &it->second;
+	}
+}
+
+// Backward Dijkstra over the product of each pattern and each DFA from the
+// accepting DFA states. DFAs with an exact table are skipped, and tables not
+// finished by the stop time are left empty
+void ProductSearch::computePatternDists() {
+	pattern_dists.clear();
+	if (!pattern_db || lazy_ts || pattern_db->numStates() != ts->size()) {
+		return;
+	}
+	const int n_patterns = pattern_db->numPatterns();
+	pattern_dists.resize(n_dfas * n_patterns);
+	typedef std::pair<float, uint32_t> Entry;
+	std::vector<Entry> heap;
+	std::vector<char> letter_seen;
+	std::vector<std::vector<uint32_t>> pattern_letters;
+	for (int i=0; i<n_dfas; ++i) {
+		if (accept_dists[i]) {
+			continue;
+		}
+		const DenseDFA& dfa = *dfas[i];
+		const std::vector<uint32_t>& table = letters[i]->letters;
+		for (int p=0; p<n_patterns; ++p) {
+			const uint32_t n_pattern_states = pattern_db->patternSize(p);
+			if (static_cast<uint64_t>(n_pattern_states) * dfa.numLetters() > max_pattern_table || pastStopTime()) {
+				continue;
+			}
+			// Letters of the TS states projecting onto each pattern state
+			letter_seen.assign(n_pattern_states * dfa.numLetters(), 0);
+			pattern_letters.assign(n_pattern_states, {});
+			for (int s=0; s<ts->size(); ++s) {
+				const uint32_t a = pattern_db->patternState(s, p);
+				char& seen = letter_seen[a * dfa.numLetters() + table[s]];
+				if (!seen) {
+					seen = 1;
+					pattern_letters[a].push_back(table[s]);
+				}
+			}
+
+			std::vector<float>& dist = pattern_dists[i * n_patterns + p];
+			dist.assign(n_pattern_states * dfa.size(), std::numeric_limits<float>::infinity());
+			heap.clear();
+			for (uint32_t a=0; a<n_pattern_states; ++a) {
+				for (int q=0; q<dfa.size(); ++q) {
+					if (dfa.isAccepting(q)) {
+						dist[a * dfa.size() + q] = 0.0f;
+						heap.push_back({0.0f, a * dfa.size() + q});
+					}
+				}
+			}
+			std::make_heap(heap.begin(), heap.end(), std::greater<Entry>());
+			int n_pops = 0;
+			while (!heap.empty()) {
+				if ((++n_pops & 4095) == 0 && pastStopTime()) {
+					dist.clear();
+					break;
+				}
+				std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+				const Entry top = heap.back();
+				heap.pop_back();
+				if (top.first > dist[top.second]) {
+					continue;
+				}
+				const uint32_t a = top.second / dfa.size();
+				const int q_next = top.second % dfa.size();
+				// (source, q) -> (a, q_next) when q reads a letter of a into q_next
+				for (uint32_t e=pattern_db->inBegin(p, a); e<pattern_db->inEnd(p, a); ++e) {
+					const uint32_t source = pattern_db->inSource(p, e);
+					const float d = top.first + pattern_db->inCost(p, e);
+					for (int q=0; q<dfa.size(); ++q) {
+						float& source_dist = dist[source * dfa.size() + q];
+						if (d >= source_dist) {
+							continue;
+						}
+						for (auto letter : pattern_letters[a]) {
+							if (dfa.step(q, letter) == q_next) {
+								source_dist = d;
+								heap.push_back({d, source * dfa.size() + q});
+								std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+								break;
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+template<class TS>
+ProductSearch::LetterTable& ProductSearch::letterTable(const TS& trans_sys, const DenseDFA& dfa) {
+	auto it = letter_tables.find(dfa.getAP());
+	if (it == letter_tables.end()) {
+		// Propositions the TS does not label are never true
+		it = letter_tables.insert({dfa.getAP(), LetterTable()}).first;
+		for (auto& ap : dfa.getAP()) {
+			auto prop_it = std::find(trans_sys.getPropLabels().begin(), trans_sys.getPropLabels().end(), ap);
+			it->second.props.push_back((prop_it != trans_sys.getPropLabels().end()) ? prop_it - trans_sys.getPropLabels().begin() : -1);
+		}
+	}
+	extendLetters(trans_sys, it->second);
+	return it->second;
+}
+
+// Letters of the states added to the TS since the table was last extended
+template<class TS>
+void ProductSearch::extendLetters(const TS& trans_sys, LetterTable& table) const {
+	const std::vector<int>& props = table.props;
+	for (int s=table.letters.size(); s<trans_sys.size(); ++s) {
+		uint32_t letter = 0;
+		for (int j=0; j<props.size(); ++j) {
+			if (props[j] >= 0 && trans_sys.hasProp(s, props[j])) {
+				letter |= 1u << j;
+			}
+		}
+		table.letters.push_back(letter);
+	}
+}
+
+void ProductSearch::expand(LazyTS& trans_sys, int state) {
+	if (trans_sys.isExpanded(state)) {
+		return;
+	}
+	trans_sys.expandState(state);
+	for (auto table : letters) {
+		extendLetters(trans_sys, *table);
+	}
+}
+
+int ProductSearch::findState(const CompactTS& trans_sys, const PackedState& s) {
+	if (state_index.empty()) {
+		state_index.reserve(trans_sys.size());
+		for (int state=0; state<trans_sys.size(); ++state) {
+			state_index[trans_sys.getState(state)] = state;
+		}
+	}
+	auto it = state_index.find(s);
+	return (it != state_index.end()) ? it->second : -1;
+}
+
+int ProductSearch::findState(LazyTS& trans_sys, const PackedState& s) {
+	const int state = trans_sys.stateId(s);
+	for (auto table : letters) {
+		extendLetters(trans_sys, *table);
+	}
+	return state;
+}
+
+// The state with the labels of sym_dims in ascending order
+template<class TS>
+int ProductSearch::canonical(TS& trans_sys, int state) {
+	if (!reduced) {
+		return state;
+	}
+	if (state >= canon_states.size()) {
+		canon_states.resize(trans_sys.size(), -1);
+	}
+	if (canon_states[state] < 0) {
+		const StateEncoding& encoding = trans_sys.getEncoding();
+		PackedState s = trans_sys.getState(state);
+		sym_labels.clear();
+		for (auto dim : sym_dims) {
+			sym_labels.push_back(encoding.get(s, dim));
+		}
+		std::sort(sym_labels.begin(), sym_labels.end());
+		for (int j=0; j<sym_dims.size(); ++j) {
+			encoding.set(s, sym_dims[j], sym_labels[j]);
+		}
+		int canon = findState(trans_sys, s);
+		if (canon < 0) {
+			sym_failed = true;
+			canon = state;
+		}
+		canon_states[state] = canon;
+	}
+	return canon_states[state];
+}
+
+// Replaces the sorted states of a plan by TS states reached from the start
+// state with the same actions
+template<class TS>
+bool ProductSearch::liftPlan(TS& trans_sys, std::vector<int>& states, const std::vector<int>& actions) {
+	int state = startState(trans_sys);
+	states[0] = state;
+	for (int k=0; k<actions.size(); ++k) {
+		expand(trans_sys, state);
+		int next_state = -1;
+		for (uint32_t e=trans_sys.edgeBegin(state); e<trans_sys.edgeEnd(state) && next_state < 0; ++e) {
+			if (trans_sys.edgeAction(e) == actions[k] && canonical(trans_sys, trans_sys.edgeTarget(e)) == states[k + 1]) {
+				next_state = trans_sys.edgeTarget(e);
+			}
+		}
+		if (next_state < 0) {
+			return false;
+		}
+		states[k + 1] = state = next_state;
+	}
+	return true;
+}
+
+int ProductSearch::internNode(NodeTable& table, const int* key) const {
+	const int key_size = n_dfas + 1;
+	const int n_nodes = table.best_label.size();
+	if (2 * (n_nodes + 1) > table.slots.size()) {
+		table.slots.assign(std::max<size_t>(64, 2 * table.slots.size()), -1);
+		const size_t mask = table.slots.size() - 1;
+		for (int n=0; n<n_nodes; ++n) {
+			size_t slot = fnv1a(&table.keys[n * key_size], key_size * sizeof(int)) & mask;
+			while (table.slots[slot] >= 0) {
+				slot = (slot + 1) & mask;
+			}
+			table.slots[slot] = n;
+		}
+	}
+	const size_t mask = table.slots.size() - 1;
+	size_t slot = fnv1a(key, key_size * sizeof(int)) & mask;
+	while (table.slots[slot] >= 0) {
+		if (std::equal(key, key + key_size, &table.keys[table.slots[slot] * key_size])) {
+			return table.slots[slot];
+		}
+		slot = (slot + 1) & mask;
+	}
+	table.slots[slot] = n_nodes;
+	table.keys.insert(table.keys.end(), key, key + key_size);
+	table.best_label.push_back(-1);
+	table.bounds.resize((n_nodes + 1) * n_dfas);
+	dfaBounds(key, table.bounds.data() + n_nodes * n_dfas);
+	float h = 0.0f;
+	for (int i=0; i<n_dfas; ++i) {
+		h = std::max(h, table.bounds[n_nodes * n_dfas + i]);
+	}
+	table.h.push_back(h);
+	return n_nodes;
+}
+
+bool ProductSearch::lexLess(const float* c_1, const float* c_2) const {
+	for (int i=0; i<n_dfas; ++i) {
+		if (c_1[i] != c_2[i]) {
+			return c_1[i] < c_2[i];
+		}
+	}
+	return false;
+}
+
+bool ProductSearch::queueLess(const QueueEntry& a, const QueueEntry& b) const {
+	if (a.f != b.f) {
+		return a.f < b.f;
+	}
+	const float* c_a = label_costs.data() + a.label * n_dfas;
+	const float* c_b = label_costs.data() + b.label * n_dfas;
+	if (lexLess(c_a, c_b)) {
+		return true;
+	}
+	if (lexLess(c_b, c_a)) {
+		return false;
+	}
+	return a.label < b.label;
+}
+
+void ProductSearch::dfaBounds(const int* key, float* bounds) const {
+	const int n_patterns = pattern_dists.empty() ? 0 : pattern_db->numPatterns();
+	for (int i=0; i<n_dfas; ++i) {
+		bounds[i] = 0.0f;
+		if (use_accept_dist) {
+			const int dist = dfas[i]->acceptDistance(key[i + 1]);
+			bounds[i] = (dist == DenseDFA::unreachable) ? std::numeric_limits<float>::infinity() : dist * min_action_cost;
+		}
+		for (int p=0; p<n_patterns; ++p) {
+			const std::vector<float>& dist = pattern_dists[i * n_patterns + p];
+			if (!dist.empty()) {
+				bounds[i] = std::max(bounds[i], dist[pattern_db->patternState(key[0], p) * dfas[i]->size() + key[i + 1]]);
+			}
+		}
+		if (accept_dists[i]) {
+			bounds[i] = std::max(bounds[i], (*accept_dists[i])[static_cast<size_t>(key[0]) * dfas[i]->size() + key[i + 1]]);
+		}
+	}
+}
+
+// Some DFA of the key is in a state it can not accept from
+bool ProductSearch::deadKey(const int* key) const {
+	for (int i=0; i<n_dfas; ++i) {
+		if (dfas[i]->hasAcceptDistances() && dfas[i]->acceptDistance(key[i + 1]) == DenseDFA::unreachable) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// False if a label with cost vector c at a node with these bounds can not
+// end in a plan with a lexicographically smaller c than goal_c
+bool ProductSearch::canImprove(const float* c, const float* bounds, const float* goal_c) const {
+	for (int i=0; i<n_dfas; ++i) {
+		const float c_min = c[i] + bounds[i];
+		if (c_min != goal_c[i]) {
+			return c_min < goal_c[i];
+		}
+	}
+	return false;
+}
+
+template<class TS>
+float ProductSearch::minActionCost(const TS& trans_sys) const {
+	float min_cost = std::numeric_limits<float>::max();
+	for (int action=0; action<trans_sys.numActions(); ++action) {
+		min_cost = std::min(min_cost, trans_sys.actionCost(action));
+	}
+	return (trans_sys.numActions() > 0) ? std::max(min_cost, 0.0f) : 0.0f;
+}
+
+template<class TS>
+bool ProductSearch::integerCosts(const TS& trans_sys) const {
+	for (int action=0; action<trans_sys.numActions(); ++action) {
+		const float cost = trans_sys.actionCost(action);
+		if (cost < 0.0f || cost > max_bucket_cost || cost != static_cast<int>(cost)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void ProductSearch::push(int label) {
+	const float f = labels[label].g + weight * nodes.h[labels[label].node];
+	if (use_buckets) {
+		bucket_queue.push(static_cast<size_t>(f), label);
+		return;
+	}
+	queue.push_back({f, label});
+	std::push_heap(queue.begin(), queue.end(), [this](const QueueEntry& a, const QueueEntry& b) {return queueLess(b, a);});
+}
+
+int ProductSearch::pop() {
+	if (use_buckets) {
+		return bucket_queue.pop();
+	}
+	std::pop_heap(queue.begin(), queue.end(), [this](const QueueEntry& a, const QueueEntry& b) {return queueLess(b, a);});
+	const int label = queue.back().label;
+	queue.pop_back();
+	return label;
+}
+
+bool ProductSearch::queueEmpty() const {
+	return use_buckets ? bucket_queue.empty() : queue.empty();
+}
+
+bool ProductSearch::extractPlan(int goal_label, std::vector<int>& states, std::vector<int>& actions) {
+	states.clear();
+	actions.clear();
+	for (int l=goal_label; l>=0; l=labels[l].parent) {
+		states.push_back(nodes.keys[labels[l].node * (n_dfas + 1)]);
+		if (labels[l].parent >= 0) {
+			actions.push_back(labels[l].action);
+		}
+	}
+	std::reverse(states.begin(), states.end());
+	std::reverse(actions.begin(), actions.end());
+	if (!reduced) {
+		return true;
+	}
+	return lazy_ts ? liftPlan(*lazy_ts, states, actions) : liftPlan(*ts, states, actions);
+}
+
+void ProductSearch::getFront(std::vector<FrontPoint>& front) {
+	front.resize(goal_front.size());
+	for (int i=0; i<goal_front.size(); ++i) {
+		const int l = goal_front[i];
+		front[i].flexibility = labels[l].g - labels[goal_front[0]].g;
+		front[i].path_length = labels[l].g;
+		front[i].cost_vector.assign(label_costs.begin() + l * n_dfas, label_costs.begin() + (l + 1) * n_dfas);
+		extractPlan(l, front[i].state_sequence, front[i].action_sequence);
+	}
+}
+
+void ProductSearch::resetPass() {
+	std::fill(nodes.best_label.begin(), nodes.best_label.end(), -1);
+	labels.clear();
+	label_costs.clear();
+	queue.clear();
+	bucket_queue.clear();
+	goal_front.clear();
+}
+
+// The start state, with the DFAs in the states reading the start path (or
+// the start state alone) leaves them in
+template<class TS>
+void ProductSearch::rootKey(TS& trans_sys, int* key) {
+	key[0] = canonical(trans_sys, startState(trans_sys));
+	for (int i=0; i<n_dfas; ++i) {
+		int q = dfas[i]->getInitState();
+		if (start_path.empty()) {
+			q = dfas[i]->step(q, letters[i]->letters[key[0]]);
+		}
+		for (auto state : start_path) {
+			q = dfas[i]->step(q, letters[i]->letters[state]);
+		}
+		key[i + 1] = q;
+	}
+}
+
+// Returns the goal label with the smallest c found, -1 if none. With
+// first_goal_only the pass ends at the first goal popped
+template<class TS>
+int ProductSearch::runPass(TS& trans_sys, bool first_goal_only, bool& timed_out) {
+	const float eps = 1e-4f;
+	const int key_size = n_dfas + 1;
+	resetPass();
+	timed_out = false;
+
+	std::vector<int> key(key_size);
+	rootKey(trans_sys, key.data());
+	const int root = internNode(nodes, key.data());
+	if (nodes.h[root] == std::numeric_limits<float>::infinity()) {
+		// Some DFA can never accept
+		return -1;
+	}
+	labels.push_back({0.0f, root, -1, -1});
+	label_costs.assign(n_dfas, 0.0f);
+	push(0);
+
+	float bound = std::numeric_limits<float>::max();
+	int goal_label = -1;
+	int n_pops = 0;
+	std::vector<float> c(n_dfas);
+	while (!queueEmpty()) {
+		if ((++n_pops & 1023) == 0 && pastStopTime()) {
+			timed_out = true;
+			break;
+		}
+		const int l = pop();
+		const Label label = labels[l];
+		if (label.g + nodes.h[label.node] > bound + eps) {
+			break;
+		}
+		const int best = nodes.best_label[label.node];
+		if (best >= 0 && !lexLess(label_costs.data() + l * n_dfas, label_costs.data() + best * n_dfas)) {
+			continue;
+		}
+		const int* node_key = &nodes.keys[label.node * key_size];
+		if (goal_label >= 0 && !canImprove(label_costs.data() + l * n_dfas, nodes.bounds.data() + label.node * n_dfas, label_costs.data() + goal_label * n_dfas)) {
+			continue;
+		}
+		nodes.best_label[label.node] = l;
+		++n_expanded;
+
+		bool goal = true;
+		for (int i=0; i<n_dfas && goal; ++i) {
+			goal = dfas[i]->isAccepting(node_key[i + 1]);
+		}
+		if (goal) {
+			if (first_goal_only) {
+				return l;
+			}
+			if (goal_label < 0) {
+				bound = label.g + flexibility;
+			}
+			if (goal_label < 0 || lexLess(label_costs.data() + l * n_dfas, label_costs.data() + goal_label * n_dfas)) {
+				goal_label = l;
+				goal_front.push_back(l);
+			}
+			continue;
+		}
+
+		const int state = node_key[0];
+		expand(trans_sys, state);
+		shortcut_targets.clear();
+		if (label.parent >= 0) {
+			const int parent_state = nodes.keys[labels[label.parent].node * key_size];
+			for (uint32_t e=trans_sys.edgeBegin(parent_state); e<trans_sys.edgeEnd(parent_state); ++e) {
+				if (trans_sys.edgeAction(e) == label.action) {
+					shortcut_targets.push_back(canonical(trans_sys, trans_sys.edgeTarget(e)));
+				}
+			}
+			std::sort(shortcut_targets.begin(), shortcut_targets.end());
+		}
+		for (uint32_t e=trans_sys.edgeBegin(state); e<trans_sys.edgeEnd(state); ++e) {
+			const int action = trans_sys.edgeAction(e);
+			const float w = trans_sys.actionCost(action);
+			const float g = label.g + w;
+			if (g > bound + eps) {
+				continue;
+			}
+			const int next_state = canonical(trans_sys, trans_sys.edgeTarget(e));
+			const int* from_key = &nodes.keys[label.node * key_size];
+			key[0] = next_state;
+			for (int i=0; i<n_dfas; ++i) {
+				c[i] = label_costs[l * n_dfas + i] + (dfas[i]->isAccepting(from_key[i + 1]) ? 0.0f : w);
+				key[i + 1] = dfas[i]->step(from_key[i + 1], letters[i]->letters[next_state]);
+			}
+			if (action == label.action && std::binary_search(shortcut_targets.begin(), shortcut_targets.end(), next_state)) {
+				bool invisible = true;
+				for (int i=0; i<n_dfas && invisible; ++i) {
+					invisible = key[i + 1] == from_key[i + 1] && letters[i]->letters[next_state] == letters[i]->letters[state];
+				}
+				if (invisible) {
+					continue;
+				}
+			}
+			if (deadKey(key.data())) {
+				continue;
+			}
+			const int next_node = internNode(nodes, key.data());
+			if (g + nodes.h[next_node] > bound + eps) {
+				continue;
+			}
+			if (goal_label >= 0 && !canImprove(c.data(), nodes.bounds.data() + next_node * n_dfas, label_costs.data() + goal_label * n_dfas)) {
+				continue;
+			}
+			const int next_best = nodes.best_label[next_node];
+			if (next_best >= 0 && !lexLess(c.data(), label_costs.data() + next_best * n_dfas)) {
+				continue;
+			}
+			labels.push_back({g, next_node, l, action});
+			label_costs.insert(label_costs.end(), c.begin(), c.end());
+			push(labels.size() - 1);
+		}
+	}
+	return goal_label;
+}
+
+// Upper bits of the hash, the lower ones pick the slot in the node table
+int ProductSearch::partitionOf(const int* key) const {
+	return (fnv1a(key, (n_dfas + 1) * sizeof(int)) >> 32) % partitions.size();
+}
+
+// Keeps a label at the partition owning its node, with the same checks as
+// the serial pass makes when generating it
+void ProductSearch::deliver(Partition& part, const Label& label, int parent_state, const int* key, const float* c, float bound, const float* goal_c) const {
+	const float eps = 1e-4f;
+	const int node = internNode(part.nodes, key);
+	if (label.g + part.nodes.h[node] > bound + eps) {
+		return;
+	}
+	if (goal_c && !canImprove(c, part.nodes.bounds.data() + node * n_dfas, goal_c)) {
+		return;
+	}
+	const int best = part.nodes.best_label[node];
+	if (best >= 0 && !lexLess(c, part.label_costs.data() + best * n_dfas)) {
+		return;
+	}
+	part.labels.push_back({label.g, node, label.parent, label.action});
+	part.parent_states.push_back(parent_state);
+	part.label_costs.insert(part.label_costs.end(), c, c + n_dfas);
+	part.bucket_queue.push(static_cast<size_t>(label.g + part.nodes.h[node]), part.labels.size() - 1);
+}
+
+// Settles the labels of partition p in the bucket, as runPass() does. Labels
+// for nodes of other partitions go to the outboxes
+void ProductSearch::expandBucket(int p, size_t bucket, float bound, const float* goal_c) {
+	const float eps = 1e-4f;
+	const int key_size = n_dfas + 1;
+	const int n_parts = partitions.size();
+	Partition& part = partitions[p];
+	std::vector<int> key(key_size);
+	std::vector<float> c(n_dfas);
+	auto canon = [this](int state) {return reduced ? canon_states[state] : state;};
+	while (!part.bucket_queue.empty() && part.bucket_queue.minPriority() == bucket) {
+		const int l = part.bucket_queue.pop();
+		const Label label = part.labels[l];
+		const int best = part.nodes.best_label[label.node];
+		if (best >= 0 && !lexLess(part.label_costs.data() + l * n_dfas, part.label_costs.data() + best * n_dfas)) {
+			continue;
+		}
+		if (goal_c && !canImprove(part.label_costs.data() + l * n_dfas, part.nodes.bounds.data() + label.node * n_dfas, goal_c)) {
+			continue;
+		}
+		part.nodes.best_label[label.node] = l;
+		++part.n_expanded;
+
+		const int state = part.nodes.keys[label.node * key_size];
+		bool goal = true;
+		for (int i=0; i<n_dfas && goal; ++i) {
+			goal = dfas[i]->isAccepting(part.nodes.keys[label.node * key_size + i + 1]);
+		}
+		if (goal) {
+			part.goals.push_back(l);
+			continue;
+		}
+
+		part.shortcut_targets.clear();
+		if (label.parent >= 0) {
+			const int parent_state = part.parent_states[l];
+			for (uint32_t e=ts->edgeBegin(parent_state); e<ts->edgeEnd(parent_state); ++e) {
+				if (ts->edgeAction(e) == label.action) {
+					part.shortcut_targets.push_back(canon(ts->edgeTarget(e)));
+				}
+			}
+			std::sort(part.shortcut_targets.begin(), part.shortcut_targets.end());
+		}
+		for (uint32_t e=ts->edgeBegin(state); e<ts->edgeEnd(state); ++e) {
+			const int action = ts->edgeAction(e);
+			const float w = ts->actionCost(action);
+			const float g = label.g + w;
+			if (g > bound + eps) {
+				continue;
+			}
+			const int next_state = canon(ts->edgeTarget(e));
+			const int* from_key = &part.nodes.keys[label.node * key_size];
+			key[0] = next_state;
+			for (int i=0; i<n_dfas; ++i) {
+				c[i] = part.label_costs[l * n_dfas + i] + (dfas[i]->isAccepting(from_key[i + 1]) ? 0.0f : w);
+				key[i + 1] = dfas[i]->step(from_key[i + 1], letters[i]->letters[next_state]);
+			}
+			if (action == label.action && std::binary_search(part.shortcut_targets.begin(), part.shortcut_targets.end(), next_state)) {
+				bool invisible = true;
+				for (int i=0; i<n_dfas && invisible; ++i) {
+					invisible = key[i + 1] == from_key[i + 1] && letters[i]->letters[next_state] == letters[i]->letters[state];
+				}
+				if (invisible) {
+					continue;
+				}
+			}
+			if (deadKey(key.data())) {
+				continue;
+			}
+			const Label next_label = {g, -1, l * n_parts + p, action};
+			const int dest = partitionOf(key.data());
+			if (dest == p) {
+				deliver(part, next_label, state, key.data(), c.data(), bound, goal_c);
+				continue;
+			}
+			Outbox& outbox = part.outboxes[dest];
+			outbox.labels.push_back(next_label);
+			outbox.parent_states.push_back(state);
+			outbox.keys.insert(outbox.keys.end(), key.begin(), key.end());
+			outbox.costs.insert(outbox.costs.end(), c.begin(), c.end());
+		}
+	}
+}
+
+// Copies a label of the parallel pass and its ancestors into 'labels', with
+// their nodes interned in 'nodes'
+int ProductSearch::importLabel(int ref, std::unordered_map<int, int>& imported) {
+	const int key_size = n_dfas + 1;
+	const int n_parts = partitions.size();
+	std::vector<int> chain;
+	int l = -1;
+	for (int r=ref; r>=0; r=partitions[r % n_parts].labels[r / n_parts].parent) {
+		auto it = imported.find(r);
+		if (it != imported.end()) {
+			l = it->second;
+			break;
+		}
+		chain.push_back(r);
+	}
+	for (auto it=chain.rbegin(); it!=chain.rend(); ++it) {
+		const Partition& part = partitions[*it % n_parts];
+		const int part_label = *it / n_parts;
+		const Label& label = part.labels[part_label];
+		const int node = internNode(nodes, &part.nodes.keys[label.node * key_size]);
+		labels.push_back({label.g, node, l, label.action});
+		label_costs.insert(label_costs.end(), part.label_costs.begin() + part_label * n_dfas, part.label_costs.begin() + (part_label + 1) * n_dfas);
+		l = labels.size() - 1;
+		imported[*it] = l;
+	}
+	return l;
+}
+
+// The exact pass of runPass() over the partitions. The goal front is copied
+// into 'labels' at the end, so the plans are extracted as after a serial pass
+int ProductSearch::runParallelPass(bool& timed_out) {
+	const float eps = 1e-4f;
+	const int key_size = n_dfas + 1;
+	const int n_parts = pool->size();
+	resetPass();
+	timed_out = false;
+	if (reduced) {
+		// canonical() fills its cache as it goes, the workers only read it
+		for (int state=0; state<ts->size(); ++state) {
+			canonical(*ts, state);
+		}
+		if (sym_failed) {
+			return -1;
+		}
+	}
+	partitions.resize(n_parts);
+	for (auto& part : partitions) {
+		part.nodes.clear();
+		part.labels.clear();
+		part.label_costs.clear();
+		part.parent_states.clear();
+		part.bucket_queue.clear();
+		part.outboxes.resize(n_parts);
+		for (auto& outbox : part.outboxes) {
+			outbox.clear();
+		}
+		part.goals.clear();
+		part.n_expanded = 0;
+	}
+
+	float bound = std::numeric_limits<float>::max();
+	std::vector<int> key(key_size);
+	rootKey(*ts, key.data());
+	const std::vector<float> root_c(n_dfas, 0.0f);
+	Partition& root_part = partitions[partitionOf(key.data())];
+	deliver(root_part, {0.0f, -1, -1, -1}, -1, key.data(), root_c.data(), bound, nullptr);
+	if (root_part.labels.empty()) {
+		// Some DFA can never accept
+		return -1;
+	}
+
+	int goal_ref = -1;
+	std::vector<float> goal_c;
+	std::vector<int> front_refs;
+	while (true) {
+		size_t bucket = std::numeric_limits<size_t>::max();
+		for (auto& part : partitions) {
+			if (!part.bucket_queue.empty()) {
+				bucket = std::min(bucket, part.bucket_queue.minPriority());
+			}
+		}
+		if (bucket == std::numeric_limits<size_t>::max() || bucket > bound + eps) {
+			break;
+		}
+		if (pastStopTime()) {
+			timed_out = true;
+			break;
+		}
+		const float* goal_ptr = goal_c.empty() ? nullptr : goal_c.data();
+		bool pending = true;
+		while (pending) {
+			pool->parallelFor(n_parts, 1, [&](int worker, size_t begin, size_t end) {
+				for (size_t p=begin; p<end; ++p) {
+					expandBucket(p, bucket, bound, goal_ptr);
+				}
+			});
+			pool->parallelFor(n_parts, 1, [&](int worker, size_t begin, size_t end) {
+				for (size_t p=begin; p<end; ++p) {
+					for (auto& sender : partitions) {
+						Outbox& outbox = sender.outboxes[p];
+						for (int j=0; j<outbox.labels.size(); ++j) {
+							deliver(partitions[p], outbox.labels[j], outbox.parent_states[j], &outbox.keys[j * key_size], &outbox.costs[j * n_dfas], bound, goal_ptr);
+						}
+						outbox.clear();
+					}
+				}
+			});
+			pending = false;
+			for (auto& part : partitions) {
+				pending = pending || (!part.bucket_queue.empty() && part.bucket_queue.minPriority() == bucket);
+			}
+			// A bucket can take many rounds
+			if (pending && pastStopTime()) {
+				timed_out = true;
+				break;
+			}
+		}
+		if (timed_out) {
+			break;
+		}
+
+		// Goals of one bucket have the same g, the smallest c is kept
+		int best_goal = -1;
+		const float* best_c = nullptr;
+		for (int p=0; p<n_parts; ++p) {
+			for (auto l : partitions[p].goals) {
+				const float* c = partitions[p].label_costs.data() + l * n_dfas;
+				if (best_goal < 0 || lexLess(c, best_c)) {
+					best_goal = l * n_parts + p;
+					best_c = c;
+				}
+			}
+			partitions[p].goals.clear();
+		}
+		if (best_goal < 0) {
+			continue;
+		}
+		if (goal_ref < 0) {
+			bound = partitions[best_goal % n_parts].labels[best_goal / n_parts].g + flexibility;
+		}
+		if (goal_ref < 0 || lexLess(best_c, goal_c.data())) {
+			goal_ref = best_goal;
+			goal_c.assign(best_c, best_c + n_dfas);
+			front_refs.push_back(goal_ref);
+		}
+	}
+	for (auto& part : partitions) {
+		n_expanded += part.n_expanded;
+	}
+
+	std::unordered_map<int, int> imported;
+	for (auto ref : front_refs) {
+		goal_front.push_back(importLabel(ref, imported));
+	}
+	return goal_front.empty() ? -1 : goal_front.back();
+}
+
+void ProductSearch::setResult(int goal_label) {
+	if (!extractPlan(goal_label, state_sequence, action_sequence)) {
+		sym_failed = true;
+		return;
+	}
+	success = true;
+	path_length = labels[goal_label].g;
+	cost_vector.assign(label_costs.begin() + goal_label * n_dfas, label_costs.begin() + (goal_label + 1) * n_dfas);
+}
+
+bool ProductSearch::search() {
+	reduced = sym_dims.size() > 1;
+	sym_failed = false;
+	runPasses();
+	if (sym_failed) {
+		// The quotient does not match the TS
+		reduced = false;
+		runPasses();
+	}
+	return success;
+}
+
+void ProductSearch::runPasses() {
+	// Weights of the anytime passes before the exact one
+	static const float anytime_weights[] = {3.0f, 2.0f, 1.5f};
+	nodes.clear();
+	success = false;
+	complete = false;
+	suboptimality = std::numeric_limits<float>::max();
+	path_length = 0.0f;
+	cost_vector.clear();
+	state_sequence.clear();
+	action_sequence.clear();
+	n_expanded = 0;
+	parallel_pass = false;
+
+	bool timed_out = false;
+	if (hasStopTime() && has_heuristic) {
+		use_buckets = false;
+		for (float w : anytime_weights) {
+			weight = w;
+			const int goal_label = lazy_ts ? runPass(*lazy_ts, true, timed_out) : runPass(*ts, true, timed_out);
+			if (sym_failed) {
+				return;
+			}
+			if (timed_out) {
+				// The weighted plans are not in the goal front
+				goal_front.clear();
+				return;
+			}
+			if (goal_label < 0) {
+				// No plan at all
+				complete = true;
+				goal_front.clear();
+				return;
+			}
+			setResult(goal_label);
+			if (sym_failed) {
+				return;
+			}
+			suboptimality = w;
+		}
+	}
+
+	// The bounds are sums of action costs, so bucket priorities stay integer
+	weight = 1.0f;
+	use_buckets = lazy_ts ? integerCosts(*lazy_ts) : integerCosts(*ts);
+	// Expanding a lazy TS is not thread safe
+	parallel_pass = pool && pool->size() > 1 && !lazy_ts && use_buckets;
+	int goal_label = -1;
+	if (parallel_pass) {
+		goal_label = runParallelPass(timed_out);
+	} else {
+		goal_label = lazy_ts ? runPass(*lazy_ts, false, timed_out) : runPass(*ts, false, timed_out);
+	}
+	if (sym_failed) {
+		return;
+	}
+	complete = !timed_out;
+	if (goal_label >= 0) {
+		setResult(goal_label);
+		suboptimality = 1.0f;
+	}
+}
+
+void ProductSearch::print() const {
+	size_t n_nodes = nodes.best_label.size();
+	if (parallel_pass) {
+		n_nodes = 0;
+		for (auto& part : partitions) {
+			n_nodes += part.nodes.best_label.size();
+		}
+	}
+	std::cout<<"Product search: "<<(success ? "found plan" : "no plan")<<" (product nodes: "<<n_nodes<<", expanded: "<<n_expanded<<", "<<(use_buckets ? "bucket queue" : "heap")<<(parallel_pass ? ", " + std::to_string(partitions.size()) + " partitions" : "")<<")"<<std::endl;
+	if (!success) {
+		return;
+	}
+	if (!complete) {
+		std::cout<<"  Deadline reached, suboptimality bound: "<<suboptimality<<std::endl;
+	}
+	std::cout<<"  Path length: "<<path_length<<"\n  Cost vector:";
+	for (auto c_i : cost_vector) {
+		std::cout<<" "<<c_i;
+	}
+	std::cout<<"\n  Actions:";
+	for (auto action : action_sequence) {
+		std::cout<<" "<<(lazy_ts ? lazy_ts->actionLabel(action) : ts->actionLabel(action));
+	}
+	std::cout<<std::endl;
+}
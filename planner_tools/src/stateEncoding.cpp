@@ -0,0 +1,105 @@
+#include<iostream>
+#include<algorithm>
+
+#include "stateEncoding.h"
+
+
+StateEncoding::StateEncoding() : n_words(0), valid(false) {}
+
+StateEncoding::StateEncoding(const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_) : dim_names(dim_names_), dim_labels(dim_labels_), n_words(1), valid(true) {
+	int word = 0, shift = 0;
+	for (int d=0; d<dim_names.size(); ++d) {
+		int bits = 0;
+		while ((1u << bits) < dim_labels[d].size()) {
+			++bits;
+		}
+		// Dimensions never straddle two words
+		if (shift + bits > 64) {
+			++word;
+			shift = 0;
+		}
+		if (word > 1) {
+			break;
+		}
+		dim_bits.push_back(bits);
+		dim_words.push_back(word);
+		dim_shifts.push_back(shift);
+		dim_masks.push_back((bits == 64) ? ~0ull : ((1ull << bits) - 1));
+		shift += bits;
+	}
+	for (int d=0; d<dim_names.size(); ++d) {
+		dim_inds[dim_names[d]] = d;
+	}
+	if (word > 1) {
+		// No layout at all rather than one that indexes past PackedState::w
+		std::cout<<"Error (StateEncoding): State space does not fit in two words"<<std::endl;
+		dim_bits.clear();
+		dim_words.clear();
+		dim_shifts.clear();
+		dim_masks.clear();
+		n_words = 0;
+		valid = false;
+		return;
+	}
+	n_words = word + 1;
+}
+
+void StateEncoding::setLabelGroup(const std::string& group, const std::vector<std::string>& group_dim_names) {
+	std::vector<int>& dims = label_groups[group];
+	dims.clear();
+	for (auto& name : group_dim_names) {
+		dims.push_back(dimIndex(name));
+	}
+}
+
+const std::vector<int>& StateEncoding::getLabelGroup(const std::string& group) const {
+	return label_groups.at(group);
+}
+
+int StateEncoding::dimIndex(const std::string& dim_name) const {
+	auto it = dim_inds.find(dim_name);
+	return (it != dim_inds.end()) ? it->second : -1;
+}
+
+int StateEncoding::labelIndex(int dim, const std::string& label) const {
+	auto it = std::find(dim_labels[dim].begin(), dim_labels[dim].end(), label);
+	return (it != dim_labels[dim].end()) ? it - dim_labels[dim].begin() : -1;
+}
+
+bool StateEncoding::encode(const std::vector<std::string>& labels, PackedState& s) const {
+	if (labels.size() != dim_names.size()) {
+		return false;
+	}
+	s = PackedState();
+	for (int d=0; d<dim_names.size(); ++d) {
+		int label_ind = labelIndex(d, labels[d]);
+		if (label_ind < 0) {
+			return false;
+		}
+		set(s, d, label_ind);
+	}
+	return true;
+}
+
+std::vector<std::string> StateEncoding::decode(const PackedState& s) const {
+	std::vector<std::string> labels(dim_names.size());
+	for (int d=0; d<dim_names.size(); ++d) {
+		labels[d] = dim_labels[d][get(s, d)];
+	}
+	return labels;
+}
+
+const std::string& StateEncoding::getVar(const PackedState& s, const std::string& dim_name) const {
+	const int d = dim_inds.at(dim_name);
+	return dim_labels[d][get(s, d)];
+}
+
+bool StateEncoding::argFindGroup(const PackedState& s, const std::string& label, const std::string& group, std::string& dim_name) const {
+	for (auto d : getLabelGroup(group)) {
+		if (dim_labels[d][get(s, d)] == label) {
+			dim_name = dim_names[d];
+			return true;
+		}
+	}
+	return false;
+}
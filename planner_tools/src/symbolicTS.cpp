@@ -0,0 +1,450 @@
+#include<iostream>
+#include<algorithm>
+#include<map>
+
+#include "symbolicTS.h"
+
+
+int SymbolicTS::numBits(int n_labels) {
+	int bits = 0;
+	while ((1 << bits) < n_labels) {
+		++bits;
+	}
+	return bits;
+}
+
+int SymbolicTS::totalBits(const std::vector<std::vector<std::string>>& dim_labels) {
+	int bits = 0;
+	for (auto& labels : dim_labels) {
+		bits += numBits(labels.size());
+	}
+	return bits;
+}
+
+SymbolicTS::SymbolicTS(const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_) :
+	encoding(dim_names_, dim_labels_),
+	bdd(2 * totalBits(dim_labels_)),
+	init_set(BDDManager::zero),
+	reachable_set(BDDManager::zero),
+	max_nodes(1 << 24) {
+		int offset = 0;
+		for (auto& labels : dim_labels_) {
+			dim_offsets.push_back(offset);
+			dim_bits.push_back(numBits(labels.size()));
+			offset += dim_bits.back();
+		}
+		std::vector<char> current(bdd.numVars(), 0), next(bdd.numVars(), 0);
+		for (int v=0; v<bdd.numVars(); ++v) {
+			((v % 2 == 0) ? current : next)[v] = 1;
+		}
+		current_vars = bdd.addVarSet(current);
+		next_vars = bdd.addVarSet(next);
+	}
+
+void SymbolicTS::setLabelGroup(const std::string& group, const std::vector<std::string>& group_dim_names) {
+	encoding.setLabelGroup(group, group_dim_names);
+}
+
+void SymbolicTS::setConditions(const std::vector<CompiledCondition>& conditions_) {
+	conditions = conditions_;
+}
+
+void SymbolicTS::setPropositions(const std::vector<CompiledCondition>& propositions_) {
+	propositions = propositions_;
+}
+
+// Bits of a label index, most significant on top
+SymbolicTS::Node SymbolicTS::labelIs(int dim, bool next, uint32_t label_ind) {
+	Node f = BDDManager::one;
+	for (int b=dim_bits[dim]-1; b>=0; --b) {
+		f = bdd.bddAnd(bdd.literal(varIndex(dim, b, next), (label_ind >> (dim_bits[dim] - 1 - b)) & 1u), f);
+	}
+	return f;
+}
+
+// Labels are compared through the global label ids of the condition
+SymbolicTS::Node SymbolicTS::valueIs(const CompiledCondition& cond, int dim, bool next, const Value& value) {
+	Node f = BDDManager::zero;
+	for (int l=0; l<encoding.numLabels(dim); ++l) {
+		const int global = cond.label_ids[dim][l];
+		if (value.dim < 0) {
+			if (global == value.global) {
+				f = bdd.bddOr(f, labelIs(dim, next, l));
+			}
+			continue;
+		}
+		for (int l_2=0; l_2<encoding.numLabels(value.dim); ++l_2) {
+			if (cond.label_ids[value.dim][l_2] == global) {
+				f = bdd.bddOr(f, bdd.bddAnd(labelIs(dim, next, l), labelIs(value.dim, value.next, l_2)));
+			}
+		}
+	}
+	return f;
+}
+
+// The label of a dimension is kept from the current to the next state
+SymbolicTS::Node SymbolicTS::sameLabel(int dim) {
+	Node f = BDDManager::one;
+	for (int b=0; b<dim_bits[dim]; ++b) {
+		f = bdd.bddAnd(f, bdd.bddNot(bdd.bddXor(bdd.literal(varIndex(dim, b, false), true), bdd.literal(varIndex(dim, b, true), true))));
+	}
+	return f;
+}
+
+SymbolicTS::Node SymbolicTS::validLabel(int dim, bool next) {
+	if (encoding.numLabels(dim) == (1 << dim_bits[dim])) {
+		return BDDManager::one;
+	}
+	Node f = BDDManager::zero;
+	for (int l=0; l<encoding.numLabels(dim); ++l) {
+		f = bdd.bddOr(f, labelIs(dim, next, l));
+	}
+	return f;
+}
+
+// Appends the cases of 'in' where the op holds, with the arguments it binds.
+// Same semantics as CompiledCondition::runOp()
+void SymbolicTS::opCases(const CompiledCondition& cond, const CompiledCondition::Op& op, bool next, const Case& in, std::vector<Case>& out) {
+	auto add = [&](Node f, const std::vector<Binding>& args) {
+		f = bdd.bddAnd(in.cond, f);
+		if (f != BDDManager::zero) {
+			out.push_back({f, args});
+		}
+	};
+	auto holds = [&](Node f) {
+		add(op.negate ? bdd.bddNot(f) : f, in.args);
+	};
+	const Value constant = {-1, next, op.value};
+	switch (op.code) {
+		case CompiledCondition::LABEL_EQUALS_VAR:
+			holds(valueIs(cond, op.dim, next, constant));
+			break;
+		case CompiledCondition::LABEL_EQUALS_LABEL:
+			holds(valueIs(cond, op.dim, next, {op.dim_2, next, -1}));
+			break;
+		case CompiledCondition::LABEL_ARG_FIND:
+			if (!op.negate) {
+				std::vector<Binding> args = in.args;
+				if (op.arg >= 0) {
+					args[op.arg] = {op.dim, {op.dim, next, -1}};
+				}
+				add(BDDManager::one, args);
+			}
+			break;
+		case CompiledCondition::GROUP_ARG_FIND_VAR:
+		case CompiledCondition::GROUP_ARG_FIND_LABEL: {
+			// The first dimension of the group holding the target is bound
+			const Value target = (op.code == CompiledCondition::GROUP_ARG_FIND_VAR) ? constant : Value{op.dim_2, next, -1};
+			Node none = BDDManager::one;
+			for (auto d : cond.groups[op.group]) {
+				const Node match = valueIs(cond, d, next, target);
+				if (!op.negate) {
+					std::vector<Binding> args = in.args;
+					if (op.arg >= 0) {
+						args[op.arg] = {d, target};
+					}
+					add(bdd.bddAnd(none, match), args);
+				}
+				none = bdd.bddAnd(none, bdd.bddNot(match));
+			}
+			if (op.negate) {
+				add(none, in.args);
+			}
+			break;
+		}
+		default: {
+			// Argument ops are false while the argument is unbound
+			const Binding& arg = in.args[op.arg];
+			if (arg.dim < 0) {
+				break;
+			}
+			if (op.code == CompiledCondition::ARG_L_EQUALS_VAR) {
+				holds(valueIs(cond, arg.dim, next, constant));
+			} else if (op.code == CompiledCondition::ARG_L_EQUALS_LABEL) {
+				holds(valueIs(cond, arg.dim, next, {op.dim_2, next, -1}));
+			} else if (op.code == CompiledCondition::ARG_V_EQUALS_VAR) {
+				holds((arg.value.dim < 0) ? ((arg.value.global == op.value) ? BDDManager::one : BDDManager::zero) : valueIs(cond, arg.value.dim, arg.value.next, constant));
+			} else {
+				holds(valueIs(cond, op.dim_2, next, arg.value));
+			}
+			break;
+		}
+	}
+}
+
+// Replaces 'cases' by the cases where the program holds. A disjunction holds
+// at its first op that holds, ops that do not hold bind nothing
+void SymbolicTS::programCases(const CompiledCondition& cond, const CompiledCondition::Program& program, bool next, std::vector<Case>& cases) {
+	if (program.ops.empty()) {
+		return;
+	}
+	std::vector<Case> out;
+	if (!program.disjunction) {
+		for (auto& op : program.ops) {
+			out.clear();
+			for (auto& c : cases) {
+				opCases(cond, op, next, c, out);
+			}
+			cases.swap(out);
+		}
+		return;
+	}
+	std::vector<Case> op_cases;
+	for (auto& c : cases) {
+		Node none = c.cond;
+		for (auto& op : program.ops) {
+			op_cases.clear();
+			opCases(cond, op, next, {none, c.args}, op_cases);
+			Node holds = BDDManager::zero;
+			for (auto& op_case : op_cases) {
+				holds = bdd.bddOr(holds, op_case.cond);
+			}
+			out.insert(out.end(), op_cases.begin(), op_cases.end());
+			none = bdd.bddAnd(none, bdd.bddNot(holds));
+		}
+	}
+	cases.swap(out);
+}
+
+// Pairs (pre, post) for which the condition holds, where post differs from
+// pre only in the dimensions the post conditions write
+SymbolicTS::Node SymbolicTS::relation(const CompiledCondition& cond) {
+	std::vector<Case> pre_cases = {{BDDManager::one, std::vector<Binding>(cond.numArgs(), {-1, {-1, false, -1}})}};
+	programCases(cond, cond.pre_program, false, pre_cases);
+	Node rel = BDDManager::zero;
+	std::vector<Case> post_cases;
+	for (auto& pre_case : pre_cases) {
+		std::vector<char> written(encoding.numDims(), 0);
+		for (auto d : cond.written_dims) {
+			written[d] = 1;
+		}
+		bool bound = true;
+		for (auto arg : cond.written_args) {
+			bound = bound && pre_case.args[arg].dim >= 0;
+			if (bound) {
+				written[pre_case.args[arg].dim] = 1;
+			}
+		}
+		if (!bound) {
+			continue;
+		}
+		Node frame = BDDManager::one;
+		for (int d=encoding.numDims()-1; d>=0; --d) {
+			frame = bdd.bddAnd(frame, written[d] ? validLabel(d, true) : sameLabel(d));
+		}
+		post_cases.assign(1, pre_case);
+		programCases(cond, cond.post_program, true, post_cases);
+		for (auto& post_case : post_cases) {
+			rel = bdd.bddOr(rel, bdd.bddAnd(post_case.cond, frame));
+		}
+	}
+	return rel;
+}
+
+bool SymbolicTS::setInitState(const std::vector<std::string>& init_state_labels) {
+	PackedState init_key;
+	if (!encoding.isValid() || !encoding.encode(init_state_labels, init_key)) {
+		std::cout<<"Error (SymbolicTS): Initial state is not in the state space"<<std::endl;
+		return false;
+	}
+	for (auto& cond : conditions) {
+		if (!cond.compile(encoding)) {
+			return false;
+		}
+	}
+	for (auto& prop : propositions) {
+		if (!prop.compile(encoding)) {
+			return false;
+		}
+	}
+	bdd.rollback();
+
+	action_labels.clear();
+	relations.clear();
+	for (auto& cond : conditions) {
+		const Node rel = relation(cond);
+		auto it = std::find(action_labels.begin(), action_labels.end(), cond.getActionLabel());
+		if (it == action_labels.end()) {
+			action_labels.push_back(cond.getActionLabel());
+			relations.push_back(rel);
+		} else {
+			Node& action_rel = relations[it - action_labels.begin()];
+			action_rel = bdd.bddOr(action_rel, rel);
+		}
+	}
+	prop_labels.clear();
+	prop_sets.clear();
+	prop_complements.clear();
+	for (auto& prop : propositions) {
+		std::vector<Case> cases = {{BDDManager::one, std::vector<Binding>(prop.numArgs(), {-1, {-1, false, -1}})}};
+		programCases(prop, prop.simple_program, false, cases);
+		Node set = BDDManager::zero;
+		for (auto& c : cases) {
+			set = bdd.bddOr(set, c.cond);
+		}
+		prop_labels.push_back(prop.getLabel());
+		prop_sets.push_back(set);
+		prop_complements.push_back(bdd.bddNot(set));
+	}
+
+	init_set = BDDManager::one;
+	for (int d=encoding.numDims()-1; d>=0; --d) {
+		init_set = bdd.bddAnd(init_set, labelIs(d, false, encoding.get(init_key, d)));
+	}
+	// Chained: each action is applied to the states reached so far, which
+	// takes fewer and smaller steps than a breadth-first frontier
+	reachable_set = init_set;
+	Node prev_set = BDDManager::zero;
+	std::vector<Node*> roots = {&init_set, &reachable_set, &prev_set};
+	for (auto& rel : relations) {
+		roots.push_back(&rel);
+	}
+	for (int p=0; p<prop_sets.size(); ++p) {
+		roots.push_back(&prop_sets[p]);
+		roots.push_back(&prop_complements[p]);
+	}
+	size_t collect_size = std::max(2 * bdd.size(), static_cast<size_t>(1) << 22);
+	while (reachable_set != prev_set) {
+		prev_set = reachable_set;
+		for (auto rel : relations) {
+			reachable_set = bdd.bddOr(reachable_set, bdd.shiftVars(bdd.andExists(reachable_set, rel, current_vars), -1));
+		}
+		if (bdd.size() > collect_size) {
+			bdd.collect(roots);
+			collect_size = std::max(2 * bdd.size(), collect_size);
+		}
+	}
+	bdd.collect(roots);
+	return true;
+}
+
+SymbolicTS::Node SymbolicTS::image(Node states) {
+	Node img = BDDManager::zero;
+	for (auto rel : relations) {
+		img = bdd.bddOr(img, bdd.andExists(states, rel, current_vars));
+	}
+	return bdd.shiftVars(img, -1);
+}
+
+SymbolicTS::Node SymbolicTS::preImage(Node states) {
+	const Node next_states = bdd.shiftVars(states, 1);
+	Node pre = BDDManager::zero;
+	for (auto rel : relations) {
+		pre = bdd.bddOr(pre, bdd.andExists(next_states, rel, next_vars));
+	}
+	return pre;
+}
+
+// Splits 'states' by the letter every DFA reads in them and appends the DFA
+// states reached from 'from'
+void SymbolicTS::splitLetters(Node states, const std::vector<const DenseDFA*>& dfas, const std::vector<std::vector<int>>& props, const std::vector<int>& from, std::vector<uint32_t>& letters, int i, int j, std::vector<std::pair<std::vector<int>, Node>>& out) {
+	if (i == dfas.size()) {
+		std::vector<int> key(dfas.size());
+		for (int k=0; k<dfas.size(); ++k) {
+			key[k] = dfas[k]->step(from[k], letters[k]);
+		}
+		out.push_back({key, states});
+		return;
+	}
+	if (j == props[i].size()) {
+		splitLetters(states, dfas, props, from, letters, i + 1, 0, out);
+		return;
+	}
+	const int p = props[i][j];
+	const Node without = (p >= 0) ? bdd.bddAnd(states, prop_complements[p]) : states;
+	if (without != BDDManager::zero) {
+		letters[i] &= ~(1u << j);
+		splitLetters(without, dfas, props, from, letters, i, j + 1, out);
+	}
+	const Node with = (p >= 0) ? bdd.bddAnd(states, prop_sets[p]) : BDDManager::zero;
+	if (with != BDDManager::zero) {
+		letters[i] |= 1u << j;
+		splitLetters(with, dfas, props, from, letters, i, j + 1, out);
+		letters[i] &= ~(1u << j);
+	}
+}
+
+// Breadth-first over the product, one set of TS states per tuple of DFA
+// states. Tuples where some DFA can no longer accept are dropped
+bool SymbolicTS::canAccept(const std::vector<const DenseDFA*>& dfas, std::chrono::steady_clock::time_point stop_time) {
+	std::vector<std::vector<int>> props(dfas.size());
+	for (int i=0; i<dfas.size(); ++i) {
+		for (auto& ap : dfas[i]->getAP()) {
+			auto it = std::find(prop_labels.begin(), prop_labels.end(), ap);
+			props[i].push_back((it != prop_labels.end()) ? it - prop_labels.begin() : -1);
+		}
+	}
+	auto live = [&](const std::vector<int>& key) {
+		for (int i=0; i<dfas.size(); ++i) {
+			if (dfas[i]->hasAcceptDistances() && dfas[i]->acceptDistance(key[i]) == DenseDFA::unreachable) {
+				return false;
+			}
+		}
+		return true;
+	};
+	auto accepting = [&](const std::vector<int>& key) {
+		for (int i=0; i<dfas.size(); ++i) {
+			if (!dfas[i]->isAccepting(key[i])) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	std::map<std::vector<int>, Node> reached, frontier, next_frontier;
+	std::vector<std::pair<std::vector<int>, Node>> split;
+	std::vector<uint32_t> letters(dfas.size(), 0);
+	std::vector<int> from(dfas.size());
+	for (int i=0; i<dfas.size(); ++i) {
+		from[i] = dfas[i]->getInitState();
+	}
+	splitLetters(init_set, dfas, props, from, letters, 0, 0, split);
+	bool result = false;
+	bool done = false;
+	for (auto& part : split) {
+		if (live(part.first)) {
+			frontier[part.first] = part.second;
+		}
+	}
+	reached = frontier;
+	while (!frontier.empty() && !done) {
+		for (auto& entry : frontier) {
+			if (accepting(entry.first)) {
+				result = true;
+				done = true;
+			}
+		}
+		next_frontier.clear();
+		for (auto it=frontier.begin(); it!=frontier.end() && !done; ++it) {
+			split.clear();
+			splitLetters(image(it->second), dfas, props, it->first, letters, 0, 0, split);
+			for (auto& part : split) {
+				if (!live(part.first)) {
+					continue;
+				}
+				auto reached_it = reached.insert({part.first, BDDManager::zero}).first;
+				const Node fresh = bdd.bddAnd(part.second, bdd.bddNot(reached_it->second));
+				if (fresh != BDDManager::zero) {
+					reached_it->second = bdd.bddOr(reached_it->second, fresh);
+					Node& next = next_frontier.insert({part.first, BDDManager::zero}).first->second;
+					next = bdd.bddOr(next, fresh);
+				}
+			}
+			if (bdd.size() > max_nodes) {
+				std::cout<<"Warning (SymbolicTS): Node limit reached, giving up"<<std::endl;
+				result = true;
+				done = true;
+			} else if (stop_time != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() > stop_time) {
+				result = true;
+				done = true;
+			}
+		}
+		frontier.swap(next_frontier);
+	}
+	bdd.rollback();
+	return result;
+}
+
+void SymbolicTS::print() const {
+	std::cout<<"Symbolic TS: "<<numReachable()<<" reachable states, "<<relations.size()<<" action relations, "<<bdd.size()<<" BDD nodes"<<std::endl;
+}
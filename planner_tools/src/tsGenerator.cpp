@@ -0,0 +1,239 @@
+#include<iostream>
+#include<algorithm>
+#include<functional>
+
+#include "tsGenerator.h"
+
+
+TSGenerator::TSGenerator(StateSpace* SS_, const std::vector<std::string>& dim_names_, const std::vector<std::vector<std::string>>& dim_labels_, WorkerPool* pool_) :
+	shards(n_shards),
+	SS(SS_),
+	encoding(dim_names_, dim_labels_),
+	use_reference(false),
+	pool(pool_) {
+		dim_strides.resize(dim_names_.size());
+		uint64_t stride = 1;
+		for (int d=dim_names_.size()-1; d>=0; --d) {
+			dim_strides[d] = stride;
+			stride *= dim_labels_[d].size();
+		}
+	}
+
+void TSGenerator::setLabelGroup(const std::string& group, const std::vector<std::string>& group_dim_names) {
+	encoding.setLabelGroup(group, group_dim_names);
+}
+
+void TSGenerator::setConditions(const std::vector<CompiledCondition>& conditions_) {
+	conditions = conditions_;
+}
+
+void TSGenerator::setPropositions(const std::vector<CompiledCondition>& propositions_) {
+	propositions = propositions_;
+}
+
+TSGenerator::Shard& TSGenerator::shardOf(const PackedState& key) {
+	return shards[PackedStateHash()(key) >> 58];
+}
+
+uint64_t TSGenerator::radixOf(const PackedState& s) const {
+	uint64_t radix = 0;
+	for (int d=0; d<encoding.numDims(); ++d) {
+		radix += encoding.get(s, d) * dim_strides[d];
+	}
+	return radix;
+}
+
+void TSGenerator::enumerateStates() {
+	const uint64_t n_all = dim_strides[0] * encoding.numLabels(0);
+	all_states.assign(n_all, State(SS));
+	all_packed.assign(n_all, PackedState());
+	pool->parallelFor(n_all, 1024, [&](int worker, size_t begin, size_t end) {
+		std::vector<std::string> labels(encoding.numDims());
+		for (size_t i=begin; i<end; ++i) {
+			for (int d=0; d<encoding.numDims(); ++d) {
+				const int label_ind = (i / dim_strides[d]) % encoding.numLabels(d);
+				labels[d] = encoding.getLabel(d, label_ind);
+				encoding.set(all_packed[i], d, label_ind);
+			}
+			all_states[i].setState(labels);
+		}
+	});
+}
+
+bool TSGenerator::generate(const std::vector<std::string>& init_state, CompactTS& ts) {
+	const int n_words = encoding.numWords();
+	PackedState init_key;
+	if (!encoding.isValid() || !encoding.encode(init_state, init_key)) {
+		std::cout<<"Error (TSGenerator): Initial state is not in the state space"<<std::endl;
+		return false;
+	}
+	for (auto& shard : shards) {
+		shard.map.clear();
+	}
+
+	// Compiled conditions are read only. The reference Conditions keep
+	// evaluation state (argument bindings), so every worker evaluates its own copy
+	std::vector<std::vector<Condition>> worker_conditions;
+	std::vector<std::vector<SimpleCondition>> worker_propositions;
+	if (use_reference) {
+		std::vector<Condition> ref_conditions(conditions.size());
+		std::vector<SimpleCondition> ref_propositions(propositions.size());
+		for (int k=0; k<conditions.size(); ++k) {
+			conditions[k].exportCondition(ref_conditions[k]);
+		}
+		for (int p=0; p<propositions.size(); ++p) {
+			propositions[p].exportCondition(ref_propositions[p]);
+		}
+		worker_conditions.assign(pool->size(), ref_conditions);
+		worker_propositions.assign(pool->size(), ref_propositions);
+		enumerateStates();
+	} else {
+		for (auto& cond : conditions) {
+			if (!cond.compile(encoding)) {
+				return false;
+			}
+		}
+		for (auto& prop : propositions) {
+			if (!prop.compile(encoding)) {
+				return false;
+			}
+		}
+	}
+	std::vector<int> action_inds(conditions.size());
+	for (int k=0; k<conditions.size(); ++k) {
+		action_inds[k] = ts.internAction(conditions[k].getActionLabel(), conditions[k].getActionCost());
+	}
+	const int prop_words = (propositions.size() + 63) / 64;
+
+	std::vector<PackedState> keys = {init_key};
+	shardOf(init_key).map[init_key] = {0, 0, 0};
+	// Successors of each frontier state as (dedup entry, key, action)
+	struct Successor {
+		Entry* entry;
+		PackedState key;
+		int action;
+	};
+	std::vector<std::vector<Successor>> successors;
+	std::vector<uint64_t> states;
+	std::vector<uint32_t> edge_offsets(1, 0);
+	std::vector<uint32_t> edge_targets;
+	std::vector<CompactTS::action_t> edge_actions;
+	std::vector<uint64_t> prop_bits;
+
+	size_t level_begin = 0;
+	int depth = 0;
+	while (level_begin < keys.size()) {
+		++depth;
+		const size_t level_end = keys.size();
+		const size_t level_size = level_end - level_begin;
+		successors.assign(level_size, {});
+
+		// Expand the frontier, recording the earliest discovery of every new state
+		pool->parallelFor(level_size, 16, [&](int worker, size_t begin, size_t end) {
+			auto discover = [&](size_t pos, const PackedState& key, int action) {
+				const uint64_t rank = (static_cast<uint64_t>(pos) << 32) | successors[pos].size();
+				Shard& shard = shardOf(key);
+				std::lock_guard<std::mutex> lock(shard.mtx);
+				auto it = shard.map.find(key);
+				if (it == shard.map.end()) {
+					it = shard.map.insert({key, {rank, depth, -1}}).first;
+				} else if (it->second.depth == depth) {
+					it->second.rank = std::min(it->second.rank, rank);
+				}
+				// Entries are never erased, so the pointer survives rehashing
+				successors[pos].push_back({&it->second, key, action});
+			};
+			if (use_reference) {
+				std::vector<Condition>& conds = worker_conditions[worker];
+				for (size_t pos=begin; pos<end; ++pos) {
+					const State* pre_state = &all_states[radixOf(keys[level_begin + pos])];
+					for (uint64_t post=0; post<all_states.size(); ++post) {
+						for (int k=0; k<conds.size(); ++k) {
+							if (conds[k].evaluate(pre_state, &all_states[post])) {
+								// Only one action per (pre, post) pair
+								discover(pos, all_packed[post], action_inds[k]);
+								break;
+							}
+						}
+					}
+				}
+				return;
+			}
+			// Successors are visited in the same (post state, condition) order as the reference path
+			std::vector<CompiledCondition::Transition> transitions;
+			for (size_t pos=begin; pos<end; ++pos) {
+				CompiledCondition::orderedSuccessors(conditions, keys[level_begin + pos], transitions);
+				for (auto& transition : transitions) {
+					discover(pos, transition.post, action_inds[transition.condition]);
+				}
+			}
+		});
+
+		// Number the new states in the order a serial expansion would have found them.
+		// The successor at its entry's rank owns the entry, which is decided
+		// without reading the ids the owners of other entries are writing
+		auto owns = [&](const Entry* entry, size_t pos, int j) {
+			return entry->depth == depth && entry->rank == ((static_cast<uint64_t>(pos) << 32) | j);
+		};
+		std::vector<size_t> new_offsets(level_size + 1, 0);
+		pool->parallelFor(level_size, 64, [&](int worker, size_t begin, size_t end) {
+			for (size_t pos=begin; pos<end; ++pos) {
+				for (int j=0; j<successors[pos].size(); ++j) {
+					if (owns(successors[pos][j].entry, pos, j)) {
+						++new_offsets[pos + 1];
+					}
+				}
+			}
+		});
+		for (size_t pos=0; pos<level_size; ++pos) {
+			new_offsets[pos + 1] += new_offsets[pos];
+		}
+		const size_t next_id = keys.size();
+		keys.resize(next_id + new_offsets[level_size]);
+		pool->parallelFor(level_size, 64, [&](int worker, size_t begin, size_t end) {
+			for (size_t pos=begin; pos<end; ++pos) {
+				size_t id = next_id + new_offsets[pos];
+				for (int j=0; j<successors[pos].size(); ++j) {
+					Entry* entry = successors[pos][j].entry;
+					if (owns(entry, pos, j)) {
+						entry->id = id;
+						keys[id] = successors[pos][j].key;
+						++id;
+					}
+				}
+			}
+		});
+
+		// Append the level to the flat arrays
+		prop_bits.resize((level_end) * prop_words, 0);
+		states.resize(level_end * n_words);
+		pool->parallelFor(level_size, 64, [&](int worker, size_t begin, size_t end) {
+			for (size_t pos=begin; pos<end; ++pos) {
+				const size_t id = level_begin + pos;
+				for (int w=0; w<n_words; ++w) {
+					states[id * n_words + w] = keys[id].w[w];
+				}
+				for (int p=0; p<propositions.size(); ++p) {
+					const bool holds = use_reference ? worker_propositions[worker][p].evaluate(&all_states[radixOf(keys[id])]) : propositions[p].evaluate(keys[id]);
+					if (holds) {
+						prop_bits[id * prop_words + p / 64] |= 1ull << (p % 64);
+					}
+				}
+			}
+		});
+		for (size_t pos=0; pos<level_size; ++pos) {
+			for (auto& succ : successors[pos]) {
+				edge_targets.push_back(succ.entry->id);
+				edge_actions.push_back(succ.action);
+			}
+			edge_offsets.push_back(edge_targets.size());
+		}
+		level_begin = level_end;
+	}
+	all_states.clear();
+	all_states.shrink_to_fit();
+	all_packed.clear();
+	all_packed.shrink_to_fit();
+	ts.assign(std::move(states), std::move(edge_offsets), std::move(edge_targets), std::move(edge_actions), std::move(prop_bits), 0);
+	return true;
+}
@@ -0,0 +1,76 @@
+#include<vector>
+
+#include<gtest/gtest.h>
+
+#include "bdd.h"
+
+
+typedef BDDManager::Node Node;
+
+TEST(BDDManager, NodesAreCanonical) {
+	BDDManager bdd(3);
+	const Node x0 = bdd.literal(0, true), x1 = bdd.literal(1, true), x2 = bdd.literal(2, true);
+	EXPECT_EQ(bdd.bddOr(bdd.bddAnd(x0, x1), bdd.bddAnd(x0, x2)), bdd.bddAnd(x0, bdd.bddOr(x1, x2)));
+	EXPECT_EQ(bdd.bddNot(bdd.bddNot(x1)), x1);
+	EXPECT_EQ(bdd.bddNot(x1), bdd.literal(1, false));
+	EXPECT_EQ(bdd.bddXor(x2, x2), BDDManager::zero);
+	EXPECT_EQ(bdd.bddOr(x0, bdd.bddNot(x0)), BDDManager::one);
+	const Node f = bdd.bddAnd(x0, x1);
+	EXPECT_EQ(bdd.var(f), 0u);
+	EXPECT_EQ(bdd.low(f), BDDManager::zero);
+	EXPECT_EQ(bdd.high(f), x1);
+}
+
+TEST(BDDManager, Quantification) {
+	BDDManager bdd(4);
+	const Node x0 = bdd.literal(0, true), x1 = bdd.literal(1, true), x2 = bdd.literal(2, true);
+	const int set_1 = bdd.addVarSet({0, 1, 0, 0});
+	EXPECT_EQ(bdd.exists(bdd.bddAnd(x0, x1), set_1), x0);
+	EXPECT_EQ(bdd.exists(bdd.bddAnd(x0, bdd.bddNot(x0)), set_1), BDDManager::zero);
+	const Node f = bdd.bddOr(x0, x1), g = bdd.bddXor(x1, x2);
+	EXPECT_EQ(bdd.andExists(f, g, set_1), bdd.exists(bdd.bddAnd(f, g), set_1));
+}
+
+TEST(BDDManager, SatCount) {
+	BDDManager bdd(4);
+	const Node x0 = bdd.literal(0, true), x1 = bdd.literal(1, true), x3 = bdd.literal(3, true);
+	const int set_01 = bdd.addVarSet({1, 1, 0, 0});
+	const int set_013 = bdd.addVarSet({1, 1, 0, 1});
+	EXPECT_EQ(bdd.satCount(bdd.bddOr(x0, x1), set_01), 3.0);
+	EXPECT_EQ(bdd.satCount(bdd.bddOr(x0, x1), set_013), 6.0);
+	EXPECT_EQ(bdd.satCount(bdd.bddXor(x1, x3), set_013), 4.0);
+	EXPECT_EQ(bdd.satCount(BDDManager::one, set_013), 8.0);
+	EXPECT_EQ(bdd.satCount(BDDManager::zero, set_013), 0.0);
+}
+
+TEST(BDDManager, ShiftVars) {
+	BDDManager bdd(4);
+	const Node f = bdd.bddOr(bdd.literal(0, true), bdd.bddNot(bdd.literal(1, true)));
+	const Node g = bdd.bddOr(bdd.literal(2, true), bdd.bddNot(bdd.literal(3, true)));
+	EXPECT_EQ(bdd.shiftVars(f, 2), g);
+	EXPECT_EQ(bdd.shiftVars(g, -2), f);
+}
+
+TEST(BDDManager, RollbackAndCollect) {
+	BDDManager bdd(6);
+	Node keep = bdd.bddAnd(bdd.literal(0, true), bdd.literal(5, false));
+	bdd.checkpoint();
+	const size_t kept_size = bdd.size();
+	Node temp = BDDManager::zero;
+	for (int v=0; v<6; ++v) {
+		temp = bdd.bddXor(temp, bdd.literal(v, true));
+	}
+	EXPECT_GT(bdd.size(), kept_size);
+	bdd.rollback();
+	EXPECT_EQ(bdd.size(), kept_size);
+	EXPECT_EQ(bdd.bddAnd(bdd.literal(0, true), bdd.literal(5, false)), keep);
+
+	temp = bdd.bddOr(bdd.literal(1, true), bdd.literal(2, true));
+	std::vector<Node*> roots = {&temp};
+	bdd.collect(roots);
+	// Only 'temp' is left, renumbered, and rebuilding it finds the same node
+	EXPECT_EQ(bdd.size(), 4u);
+	EXPECT_EQ(bdd.bddOr(bdd.literal(1, true), bdd.literal(2, true)), temp);
+	const int all = bdd.addVarSet(std::vector<char>(6, 1));
+	EXPECT_EQ(bdd.satCount(temp, all), 48.0);
+}
@@ -0,0 +1,102 @@
+#include<string>
+#include<vector>
+
+#include<gtest/gtest.h>
+
+#include "denseDFA.h"
+#include "ltlfTranslator.h"
+
+
+namespace {
+	bool accepts(const DenseDFA& dfa, const std::vector<unsigned>& word) {
+		int q = dfa.getInitState();
+		for (auto letter : word) {
+			q = dfa.step(q, letter);
+		}
+		return dfa.isAccepting(q);
+	}
+
+	// Same acceptance on every word of up to 'max_length' letters
+	void expectSameLanguage(const DenseDFA& lhs, const DenseDFA& rhs, int max_length) {
+		ASSERT_EQ(lhs.numLetters(), rhs.numLetters());
+		std::vector<unsigned> word;
+		for (int length=0; length<=max_length; ++length) {
+			word.assign(length, 0);
+			while (true) {
+				EXPECT_EQ(accepts(lhs, word), accepts(rhs, word));
+				int i = 0;
+				while (i < length && ++word[i] == lhs.numLetters()) {
+					word[i++] = 0;
+				}
+				if (i == length) {
+					break;
+				}
+			}
+		}
+	}
+
+	// "Eventually a" with every state doubled and one unreachable state
+	DenseDFA redundantEventually() {
+		DenseDFA dfa;
+		dfa.resize({"a"}, 5);
+		dfa.setInitState(0);
+		dfa.setAccepting(2, true);
+		dfa.setAccepting(3, true);
+		dfa.setTransition(0, 0, 1);
+		dfa.setTransition(0, 1, 2);
+		dfa.setTransition(1, 0, 0);
+		dfa.setTransition(1, 1, 3);
+		for (unsigned letter=0; letter<2; ++letter) {
+			dfa.setTransition(2, letter, 3);
+			dfa.setTransition(3, letter, 2);
+			dfa.setTransition(4, letter, 2);
+		}
+		return dfa;
+	}
+}
+
+TEST(DenseDFAMinimize, MergesEquivalentAndDropsUnreachableStates) {
+	DenseDFA dfa = redundantEventually();
+	const DenseDFA original = dfa;
+	dfa.minimize();
+	EXPECT_EQ(dfa.size(), 2);
+	EXPECT_EQ(dfa.getInitState(), 0);
+	EXPECT_FALSE(dfa.isAccepting(0));
+	expectSameLanguage(original, dfa, 6);
+}
+
+TEST(DenseDFAMinimize, EquivalentAutomataBecomeEqual) {
+	DenseDFA dfa = redundantEventually();
+	dfa.minimize();
+	LTLfTranslator translator;
+	DenseDFA translated;
+	ASSERT_TRUE(translator.translate("F a", translated)) << translator.getError();
+	translated.minimize();
+	EXPECT_EQ(dfa.fingerprint(), translated.fingerprint());
+}
+
+TEST(DenseDFAMinimize, EmptyLanguageHasOneState) {
+	DenseDFA dfa;
+	dfa.resize({"a", "b"}, 3);
+	dfa.setInitState(1);
+	for (int q=0; q<3; ++q) {
+		for (unsigned letter=0; letter<4; ++letter) {
+			dfa.setTransition(q, letter, (q + letter) % 3);
+		}
+	}
+	dfa.minimize();
+	EXPECT_EQ(dfa.size(), 1);
+	dfa.computeAcceptDistances();
+	EXPECT_EQ(dfa.acceptDistance(0), DenseDFA::unreachable);
+}
+
+TEST(DenseDFAMinimize, KeepsAcceptDistances) {
+	LTLfTranslator translator;
+	DenseDFA dfa;
+	ASSERT_TRUE(translator.translate("X X a", dfa)) << translator.getError();
+	const DenseDFA original = dfa;
+	dfa.minimize();
+	dfa.computeAcceptDistances();
+	expectSameLanguage(original, dfa, 5);
+	EXPECT_EQ(dfa.acceptDistance(dfa.getInitState()), 3);
+}
@@ -0,0 +1,36 @@
+#include<string>
+#include<cstdlib>
+
+#include<gtest/gtest.h>
+
+#include "dfaCache.h"
+
+
+TEST(DFACacheNormalize, DropsWhitespaceBetweenTokensOfDifferentKinds) {
+	EXPECT_EQ(DFACache::normalize(" F  a "), "F a");
+	EXPECT_EQ(DFACache::normalize("  F( a &  b ) "), "F(a&b)");
+	EXPECT_EQ(DFACache::normalize("G (a\t->\nF b)"), "G(a->F b)");
+}
+
+TEST(DFACacheNormalize, KeepsWhitespaceThatSeparatesTokens) {
+	// "aUb" is one proposition, "a U b" is an until
+	EXPECT_EQ(DFACache::normalize("a U b"), "a U b");
+	EXPECT_EQ(DFACache::normalize("a   U\tb"), "a U b");
+	EXPECT_NE(DFACache::normalize("a U b"), DFACache::normalize("aUb"));
+	EXPECT_EQ(DFACache::normalize("X F a"), "X F a");
+	EXPECT_EQ(DFACache::normalize("! !a"), "! !a");
+	EXPECT_NE(DFACache::normalize("[ ]a"), DFACache::normalize("[]a"));
+}
+
+TEST(DFACache, SpacingVariantsShareOneDFA) {
+	char cache_dir[] = "/tmp/dfa_cache_test_XXXXXX";
+	ASSERT_NE(mkdtemp(cache_dir), nullptr);
+	LTLfTranslator translator;
+	DFACache cache(cache_dir, &translator, nullptr);
+	DenseDFA* dense_dfa = cache.getDense("F(a & X b)");
+	ASSERT_NE(dense_dfa, nullptr);
+	EXPECT_EQ(cache.getDense("F( a&X  b )"), dense_dfa);
+	EXPECT_NE(cache.get("F(a & X b)"), nullptr);
+	EXPECT_TRUE(cache.contains("F (a & X b)"));
+	EXPECT_EQ(cache.size(), 1);
+}
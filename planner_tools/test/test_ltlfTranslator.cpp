@@ -0,0 +1,95 @@
+#include<string>
+#include<vector>
+#include<algorithm>
+
+#include<gtest/gtest.h>
+
+#include "ltlfTranslator.h"
+
+
+namespace {
+	// Letter in which exactly the propositions in 'holding' are true
+	unsigned letter(const DenseDFA& dfa, const std::vector<std::string>& holding) {
+		unsigned l = 0;
+		const std::vector<std::string>& ap = dfa.getAP();
+		for (int i=0; i<ap.size(); ++i) {
+			if (std::find(holding.begin(), holding.end(), ap[i]) != holding.end()) {
+				l |= 1u << i;
+			}
+		}
+		return l;
+	}
+
+	bool accepts(const DenseDFA& dfa, const std::vector<std::vector<std::string>>& word) {
+		int q = dfa.getInitState();
+		for (auto& holding : word) {
+			q = dfa.step(q, letter(dfa, holding));
+		}
+		return dfa.isAccepting(q);
+	}
+
+	std::vector<std::string> parseAP(const std::string& formula) {
+		LTLfTranslator translator;
+		std::vector<std::string> ap;
+		EXPECT_TRUE(translator.parse(formula, ap)) << formula << ": " << translator.getError();
+		std::sort(ap.begin(), ap.end());
+		return ap;
+	}
+}
+
+TEST(LTLfTranslatorParse, SpacedOperators) {
+	EXPECT_EQ(parseAP("a U b"), std::vector<std::string>({"a", "b"}));
+	EXPECT_EQ(parseAP("F a"), std::vector<std::string>({"a"}));
+	EXPECT_EQ(parseAP("X F a"), std::vector<std::string>({"a"}));
+	EXPECT_EQ(parseAP("G (obj_1_L1 -> F obj_2_L3)"), std::vector<std::string>({"obj_1_L1", "obj_2_L3"}));
+	// Without the spaces these are single propositions
+	EXPECT_EQ(parseAP("aUb"), std::vector<std::string>({"aUb"}));
+	EXPECT_EQ(parseAP("Fa"), std::vector<std::string>({"Fa"}));
+}
+
+TEST(LTLfTranslatorParse, RejectsMalformedFormulas) {
+	LTLfTranslator translator;
+	std::vector<std::string> ap;
+	EXPECT_FALSE(translator.parse("a U", ap));
+	EXPECT_FALSE(translator.parse("(a & b", ap));
+	EXPECT_FALSE(translator.parse("a b", ap));
+}
+
+TEST(LTLfTranslator, Until) {
+	LTLfTranslator translator;
+	DenseDFA dfa;
+	ASSERT_TRUE(translator.translate("a U b", dfa)) << translator.getError();
+	EXPECT_TRUE(accepts(dfa, {{"b"}}));
+	EXPECT_TRUE(accepts(dfa, {{"a"}, {"a"}, {"b"}}));
+	EXPECT_FALSE(accepts(dfa, {{"a"}, {"a"}}));
+	EXPECT_FALSE(accepts(dfa, {{"a"}, {}, {"b"}}));
+}
+
+TEST(LTLfTranslator, NextEventually) {
+	LTLfTranslator translator;
+	DenseDFA dfa;
+	ASSERT_TRUE(translator.translate("X F a", dfa)) << translator.getError();
+	EXPECT_FALSE(accepts(dfa, {{"a"}}));
+	EXPECT_FALSE(accepts(dfa, {{"a"}, {}}));
+	EXPECT_TRUE(accepts(dfa, {{}, {"a"}}));
+	EXPECT_TRUE(accepts(dfa, {{}, {}, {"a"}, {}}));
+}
+
+TEST(LTLfTranslator, GloballyImplies) {
+	LTLfTranslator translator;
+	DenseDFA dfa;
+	ASSERT_TRUE(translator.translate("G(a -> F b)", dfa)) << translator.getError();
+	EXPECT_TRUE(accepts(dfa, {{}, {}}));
+	EXPECT_TRUE(accepts(dfa, {{"a"}, {"b"}}));
+	EXPECT_FALSE(accepts(dfa, {{"a"}, {"b"}, {"a"}}));
+	EXPECT_TRUE(accepts(dfa, {{"a", "b"}}));
+}
+
+TEST(LTLfTranslator, NegationAndConjunction) {
+	LTLfTranslator translator;
+	DenseDFA dfa;
+	ASSERT_TRUE(translator.translate("!(F a) & F b", dfa)) << translator.getError();
+	EXPECT_TRUE(accepts(dfa, {{}, {"b"}}));
+	EXPECT_FALSE(accepts(dfa, {{"a"}, {"b"}}));
+	EXPECT_FALSE(accepts(dfa, {{}, {}}));
+}
@@ -0,0 +1,125 @@
+#include<string>
+#include<vector>
+#include<fstream>
+#include<cstdio>
+#include<cstdlib>
+#include<unistd.h>
+
+#include<gtest/gtest.h>
+
+#include "planCache.h"
+
+
+namespace {
+	PackedState packed(uint64_t w0, uint64_t w1) {
+		PackedState s;
+		s.w[0] = w0;
+		s.w[1] = w1;
+		return s;
+	}
+
+	std::string tempFilename() {
+		char filename[] = "/tmp/plan_cache_test_XXXXXX";
+		const int fd = mkstemp(filename);
+		EXPECT_GE(fd, 0);
+		close(fd);
+		remove(filename);
+		return filename;
+	}
+}
+
+TEST(PlanCache, KeyDependsOnEveryPart) {
+	const PackedState a = packed(1, 0), b = packed(1, 1);
+	const std::string key = PlanCache::makeKey(7, a, {"F a", "G b"}, 0.5f);
+	EXPECT_EQ(key, PlanCache::makeKey(7, a, {"F a", "G b"}, 0.5f));
+	EXPECT_NE(key, PlanCache::makeKey(8, a, {"F a", "G b"}, 0.5f));
+	EXPECT_NE(key, PlanCache::makeKey(7, b, {"F a", "G b"}, 0.5f));
+	EXPECT_NE(key, PlanCache::makeKey(7, a, {"G b", "F a"}, 0.5f));
+	EXPECT_NE(key, PlanCache::makeKey(7, a, {"F a", "G b"}, 0.25f));
+}
+
+TEST(PlanCache, EvictsLeastRecentlyUsed) {
+	PlanCache cache(2, "");
+	const PlanCache::Entry entry{true, 1.0f, 0.0f, {1.0f}, {packed(1, 0)}, {}};
+	const std::string k1 = PlanCache::makeKey(0, packed(1, 0), {"F a"}, 0.0f);
+	const std::string k2 = PlanCache::makeKey(0, packed(2, 0), {"F a"}, 0.0f);
+	const std::string k3 = PlanCache::makeKey(0, packed(3, 0), {"F a"}, 0.0f);
+	cache.insert(k1, entry);
+	cache.insert(k2, entry);
+	EXPECT_NE(cache.find(k1), nullptr);
+	cache.insert(k3, entry);
+	EXPECT_EQ(cache.size(), 2u);
+	EXPECT_EQ(cache.find(k2), nullptr);
+	EXPECT_NE(cache.find(k1), nullptr);
+	EXPECT_NE(cache.find(k3), nullptr);
+	EXPECT_EQ(cache.numLookups(), 4u);
+	EXPECT_EQ(cache.numHits(), 3u);
+}
+
+TEST(PlanCache, DisabledWithZeroCapacity) {
+	PlanCache cache(0, "");
+	const std::string key = PlanCache::makeKey(0, packed(1, 0), {"F a"}, 0.0f);
+	cache.insert(key, PlanCache::Entry{true, 1.0f, 0.0f, {}, {}, {}});
+	EXPECT_FALSE(cache.enabled());
+	EXPECT_EQ(cache.find(key), nullptr);
+	EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(PlanCache, SaveLoadRoundTrip) {
+	const std::string filename = tempFilename();
+	const std::string k1 = PlanCache::makeKey(3, packed(5, 0), {"F a", "a U b"}, 0.5f);
+	const std::string k2 = PlanCache::makeKey(3, packed(6, 9), {"G !c"}, 0.0f);
+	const PlanCache::Entry e1{true, 4.0f, 1.5f, {2.0f, 4.0f}, {packed(5, 0), packed(6, 9), packed(7, 1ull << 63)}, {"transit_up", "grasp"}};
+	const PlanCache::Entry e2{false, 0.0f, 0.0f, {}, {}, {}};
+	{
+		PlanCache cache(8, filename);
+		cache.insert(k1, e1);
+		cache.insert(k2, e2);
+		// Written on flush() or destruction, not on insertion
+		EXPECT_FALSE(std::ifstream(filename).good());
+		EXPECT_TRUE(cache.flush());
+	}
+	PlanCache loaded(8, filename);
+	ASSERT_EQ(loaded.size(), 2u);
+	const PlanCache::Entry* entry = loaded.find(k1);
+	ASSERT_NE(entry, nullptr);
+	EXPECT_TRUE(entry->success);
+	EXPECT_EQ(entry->path_length, e1.path_length);
+	EXPECT_EQ(entry->suboptimality, e1.suboptimality);
+	EXPECT_EQ(entry->cost_vector, e1.cost_vector);
+	EXPECT_EQ(entry->state_sequence, e1.state_sequence);
+	EXPECT_EQ(entry->action_sequence, e1.action_sequence);
+	entry = loaded.find(k2);
+	ASSERT_NE(entry, nullptr);
+	EXPECT_FALSE(entry->success);
+	EXPECT_TRUE(entry->state_sequence.empty());
+
+	// The most recent plans survive loading into a smaller cache
+	PlanCache smaller(1, filename);
+	EXPECT_EQ(smaller.size(), 1u);
+	EXPECT_NE(smaller.find(k2), nullptr);
+	remove(filename.c_str());
+}
+
+TEST(PlanCache, DestructorWritesChanges) {
+	const std::string filename = tempFilename();
+	const std::string key = PlanCache::makeKey(1, packed(2, 0), {"X a"}, 1.0f);
+	{
+		PlanCache cache(4, filename);
+		cache.insert(key, PlanCache::Entry{true, 2.0f, 0.0f, {2.0f}, {packed(2, 0), packed(3, 0)}, {"release"}});
+	}
+	PlanCache loaded(4, filename);
+	EXPECT_NE(loaded.find(key), nullptr);
+	remove(filename.c_str());
+}
+
+TEST(PlanCache, RejectsForeignFiles) {
+	const std::string filename = tempFilename();
+	{
+		std::ofstream file(filename);
+		file<<"not a plan cache";
+	}
+	PlanCache cache(4, filename);
+	EXPECT_EQ(cache.size(), 0u);
+	remove(filename.c_str());
+}
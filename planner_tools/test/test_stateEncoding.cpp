@@ -0,0 +1,84 @@
+#include<string>
+#include<vector>
+
+#include<gtest/gtest.h>
+
+#include "stateEncoding.h"
+
+
+namespace {
+	std::vector<std::string> labels(int n) {
+		std::vector<std::string> out;
+		for (int i=0; i<n; ++i) {
+			out.push_back("L" + std::to_string(i));
+		}
+		return out;
+	}
+}
+
+TEST(StateEncoding, EncodeDecodeRoundTrip) {
+	StateEncoding encoding({"eeLoc", "ee", "obj_1"}, {{"L0", "L1", "L2"}, {"T", "F"}, {"L0", "L1", "L2", "ee"}});
+	ASSERT_TRUE(encoding.isValid());
+	EXPECT_EQ(encoding.numWords(), 1);
+	PackedState s;
+	ASSERT_TRUE(encoding.encode({"L2", "F", "ee"}, s));
+	EXPECT_EQ(encoding.get(s, 0), 2u);
+	EXPECT_EQ(encoding.get(s, 1), 1u);
+	EXPECT_EQ(encoding.get(s, 2), 3u);
+	EXPECT_EQ(encoding.decode(s), std::vector<std::string>({"L2", "F", "ee"}));
+	EXPECT_EQ(encoding.getVar(s, "obj_1"), "ee");
+	EXPECT_FALSE(encoding.encode({"L2", "F", "L9"}, s));
+	EXPECT_FALSE(encoding.encode({"L2", "F"}, s));
+}
+
+TEST(StateEncoding, SetLeavesOtherDimensions) {
+	StateEncoding encoding({"a", "b", "c"}, {labels(5), labels(7), labels(2)});
+	ASSERT_TRUE(encoding.isValid());
+	PackedState s;
+	ASSERT_TRUE(encoding.encode({"L4", "L6", "L1"}, s));
+	encoding.set(s, 1, 2);
+	EXPECT_EQ(encoding.decode(s), std::vector<std::string>({"L4", "L2", "L1"}));
+	PackedState mask;
+	encoding.addToMask(mask, 1);
+	PackedState other;
+	ASSERT_TRUE(encoding.encode({"L4", "L0", "L1"}, other));
+	EXPECT_EQ(s.w[0] & ~mask.w[0], other.w[0] & ~mask.w[0]);
+}
+
+TEST(StateEncoding, SecondWordWithoutStraddling) {
+	// 21 dimensions of 3 bits fill 63 bits, the 22nd goes to the second word
+	std::vector<std::string> dim_names;
+	std::vector<std::vector<std::string>> dim_labels;
+	std::vector<std::string> state;
+	for (int d=0; d<30; ++d) {
+		dim_names.push_back("obj_" + std::to_string(d));
+		dim_labels.push_back(labels(8));
+		state.push_back("L" + std::to_string(d % 8));
+	}
+	StateEncoding encoding(dim_names, dim_labels);
+	ASSERT_TRUE(encoding.isValid());
+	EXPECT_EQ(encoding.numWords(), 2);
+	PackedState s;
+	ASSERT_TRUE(encoding.encode(state, s));
+	EXPECT_EQ(encoding.decode(s), state);
+	EXPECT_EQ(s.w[0] >> 63, 0u);
+	PackedState t = s;
+	encoding.set(t, 21, 7);
+	EXPECT_EQ(t.w[0], s.w[0]);
+	EXPECT_NE(t.w[1], s.w[1]);
+}
+
+TEST(StateEncoding, TooManyBitsIsInvalid) {
+	// 43 dimensions of 3 bits need 129 bits
+	std::vector<std::string> dim_names;
+	std::vector<std::vector<std::string>> dim_labels;
+	for (int d=0; d<43; ++d) {
+		dim_names.push_back("obj_" + std::to_string(d));
+		dim_labels.push_back(labels(8));
+	}
+	StateEncoding encoding(dim_names, dim_labels);
+	EXPECT_FALSE(encoding.isValid());
+	EXPECT_EQ(encoding.numWords(), 0);
+	// Names are still known, only the packing is missing
+	EXPECT_EQ(encoding.dimIndex("obj_42"), 42);
+}
@@ -0,0 +1,62 @@
+#!/usr/bin/env python
+# Long-lived wrapper around task_planner's formula2dfa.py used by planner_node.
+#
+# Reads one request per line from stdin: "<formula>\t<dfa filename>", runs the
+# formula2dfa.py translation in-process (so Spot is only imported once) and
+# replies "ok" or "error <message>" on stdout.
+import argparse
+import os
+import runpy
+import shutil
+import sys
+import tempfile
+import traceback
+
+
+def translate(formula2dfa_script, formula, dfa_filename):
+    tmp_dir = tempfile.mkdtemp(prefix="formula2dfa_")
+    try:
+        saved_argv, saved_stdout = sys.argv, sys.stdout
+        sys.argv = [formula2dfa_script, "--dfa_path", tmp_dir, "--formulas", formula]
+        # Keep the translator's own printing off the reply pipe
+        sys.stdout = sys.stderr
+        try:
+            runpy.run_path(formula2dfa_script, run_name="__main__")
+        except SystemExit:
+            pass
+        finally:
+            sys.argv, sys.stdout = saved_argv, saved_stdout
+        tmp_filename = os.path.join(tmp_dir, "dfa_0.txt")
+        if not os.path.isfile(tmp_filename):
+            raise RuntimeError("formula2dfa.py did not produce a dfa file")
+        # Move into place atomically so readers never see a partial file
+        staged_filename = dfa_filename + ".tmp"
+        shutil.copyfile(tmp_filename, staged_filename)
+        os.rename(staged_filename, dfa_filename)
+    finally:
+        shutil.rmtree(tmp_dir, ignore_errors=True)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--formula2dfa_path", required=True)
+    args = parser.parse_args()
+    formula2dfa_script = os.path.join(args.formula2dfa_path, "formula2dfa.py")
+    sys.path.insert(0, args.formula2dfa_path)
+
+    for line in iter(sys.stdin.readline, ""):
+        line = line.rstrip("\n")
+        if not line:
+            continue
+        try:
+            formula, dfa_filename = line.split("\t")
+            translate(formula2dfa_script, formula, dfa_filename)
+            sys.stdout.write("ok\n")
+        except Exception as e:
+            traceback.print_exc(file=sys.stderr)
+            sys.stdout.write("error " + str(e).replace("\n", " ") + "\n")
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
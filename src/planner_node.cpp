@@ -1,4 +1,12 @@
 // System
+#include<thread>
+#include<chrono>
+#include<algorithm>
+#include<sstream>
+#include<iomanip>
+#include<unordered_map>
+#include<memory>
+#include<deque>
 #include<boost/filesystem.hpp>
 
 // ROS
@@ -7,6 +15,9 @@
 #include "manipulation_interface/ActionSingle.h"
 #include "manipulation_interface/PreferenceQuery.h"
 #include "manipulation_interface/RunQuery.h"
+#include "manipulation_interface/BatchPreferenceQuery.h"
+#include "manipulation_interface/FlexibilitySweepQuery.h"
+#include "manipulation_interface/ExtendEnvironment.h"
 
 // Task Planner
 #include "graph.h"
@@ -16,59 +27,378 @@
 #include "state.h"
 #include "symbSearch.h"
 
+// Planner Tools
+#include "dfaCache.h"
+#include "planCache.h"
+#include "compactTS.h"
+#include "lazyTS.h"
+#include "patternDB.h"
+#include "tsGenerator.h"
+#include "compiledCondition.h"
+#include "productSearch.h"
+#include "hierarchicalSearch.h"
+#include "symbolicTS.h"
+#include "workerPool.h"
+#include "hashUtils.h"
 
 
+
+// Everything built from the discrete environment. Not moved once built, the
+// transition systems and their states point into it
+struct Environment {
+	std::vector<std::string> obj_group;
+	std::vector<std::string> loc_labels;
+	std::vector<std::string> init_obj_locations;
+	StateSpace SS_MANIPULATOR;
+	std::unique_ptr<State> init_state;
+	std::vector<Condition> conds_m;
+	std::vector<Condition*> cond_ptrs_m;
+	std::vector<SimpleCondition> AP_m;
+	std::vector<SimpleCondition*> AP_m_ptrs;
+	TS_EVAL<State> ts_eval; // Only for SymbSearch, restored from compact_ts when first needed
+	bool ts_eval_ready;
+	std::deque<State> ts_eval_states;
+	CompactTS compact_ts;
+	std::unique_ptr<LazyTS> lazy_ts; // Planned over instead of compact_ts if set
+	std::unique_ptr<SymbolicTS> symbolic_ts;
+	PatternDB pattern_db;
+	bool pattern_db_ready;
+	uint64_t ts_key; // Hash of the dimensions, labels and conditions
+	std::unique_ptr<LazyTS> abstract_ts;
+	std::unique_ptr<HierarchicalSearch> hierarchical_search;
+	Environment() : ts_eval(true, false, 0), ts_eval_ready(false), pattern_db_ready(false), ts_key(0) {}
+};
+
+bool buildEnvironment(Environment& env, ros::NodeHandle& planner_NH, ros::NodeHandle& planner_private_NH, WorkerPool& worker_pool);
+
 class PlanSrv {
 	private: 
+		struct Plan {
+			bool success;
+			float pathlength;
+			std::vector<float> formula_costs;
+			std::vector<const State*> states;
+			std::vector<int> state_ids; // Only from the product and hierarchical searches
+			std::vector<std::string> actions;
+			bool complete; // False if a deadline stopped the search early
+			float suboptimality;
+			Plan() : success(false), pathlength(0.0f), complete(true), suboptimality(1.0f) {}
+		};
+
 		SymbSearch search_obj;
+		std::unique_ptr<Environment> env;
 	 	TS_EVAL<State>* ts_ptr;
+		const CompactTS* compact_ts;
+		LazyTS* lazy_ts; // Planned over instead of the generated TS if set
+		const PatternDB* pattern_db;
+		StateSpace* SS;
+		std::unordered_map<int, State> decoded_states; // TS states that have been in a plan
+		DFACache* dfa_cache;
+		PlanCache* plan_cache; // Complete dense plans of plan()
 		std::vector<DFA_EVAL*> dfa_eval_ptrs;
-		const std::vector<std::string>& obj_group;
+		ProductSearch product_search;
+		HierarchicalSearch* hierarchical_search; // Tried before product_search if set
+		SymbolicTS* symbolic_ts; // Rules out queries no path can satisfy if set
+		std::vector<ProductSearch> batch_searches; // One per worker
+		const bool use_product_search;
+		const bool use_symmetry_reduction;
+		const bool use_parallel_search;
+		const int accept_table_size;
+		const int max_replans; // Per run()
+		WorkerPool* pool;
+		std::vector<std::string> obj_group;
 		ros::NodeHandle* current_NH;
-		std::string formulaListToStr(const std::vector<std::string>& list) {
-			std::string ret_str = "";
-			for (auto& formula : list) {
-				ret_str += " \"" + formula + "\"";
+		ros::NodeHandle* private_NH;
+
+		// Last plan, sent by run()
+		std::vector<const State*> plan_states;
+		std::vector<std::string> plan_actions;
+		// Its query, to plan the rest again when an action fails, and the TS
+		// states executed before its first one
+		std::vector<std::string> plan_formulas;
+		float plan_flexibility;
+		float plan_deadline;
+		std::vector<int> plan_prefix;
+
+		// Look up the DFAs, only formulas that have never been seen are
+		// translated, and by the worker only until 'stop_time':
+		bool getDFAs(const std::vector<std::string>& formulas_ordered, std::chrono::steady_clock::time_point stop_time, std::vector<DFA*>& dfa_arr) {
+			dfa_arr.resize(formulas_ordered.size());
+			for (int i=0; i<formulas_ordered.size(); ++i) {
+				bool cached = dfa_cache->contains(formulas_ordered[i]);
+				dfa_arr[i] = dfa_cache->get(formulas_ordered[i], stop_time);
+				if (!dfa_arr[i]) {
+					ROS_ERROR("Could not get DFA for formula: %s", formulas_ordered[i].c_str());
+					return false;
+				}
+				if (!cached) {
+					std::cout<<"\nLoaded DFA for formula: "<<formulas_ordered[i]<<"\n"<<std::endl;
+					dfa_arr[i]->print();
+				}
 			}
-			return ret_str;
+			return true;
 		}
-	public:
-		PlanSrv(TS_EVAL<State>* ts_ptr_, const std::vector<std::string>& obj_group_, ros::NodeHandle* current_NH_) : ts_ptr(ts_ptr_), obj_group(obj_group_), current_NH(current_NH_) {}
-		bool plan(manipulation_interface::PreferenceQuery::Request& req, manipulation_interface::PreferenceQuery::Response& res) {
-			clearDFAPtrs();
 
-			int N_DFAs = req.formulas_ordered.size();
+		// Dense DFA tables over the precomputed TS proposition bitsets, false
+		// for DFAs with too many propositions (those are left to SymbSearch)
+		bool getDenseDFAs(const std::vector<std::string>& formulas_ordered, std::chrono::steady_clock::time_point stop_time, std::vector<const DenseDFA*>& dense_dfas) {
+			dense_dfas.resize(formulas_ordered.size());
+			for (int i=0; i<formulas_ordered.size(); ++i) {
+				dense_dfas[i] = dfa_cache->getDense(formulas_ordered[i], stop_time);
+				if (!dense_dfas[i]) {
+					return false;
+				}
+			}
+			return true;
+		}
 
-			//std::cout<<"ROS PACKAGE PATH: "<<ros::package::getPath("manipulation_interface")<<std::endl;
+		// TS states are decoded when they first appear in a plan, so that a
+		// restored compact TS does not need ts_ptr
+		const State* getState(int state) {
+			auto it = decoded_states.find(state);
+			if (it == decoded_states.end()) {
+				it = decoded_states.emplace(state, State(SS)).first;
+				it->second.setState(lazy_ts ? lazy_ts->getStateLabels(state) : compact_ts->getStateLabels(state));
+			}
+			return &it->second;
+		}
 
-			// Create DFA files:
-			std::string home_dir = getenv("HOME");
-			std::string python_executable = home_dir + "/anaconda3/envs/tpenv/bin/python";
-			std::string formula2dfa_path = ros::package::getPath("manipulation_interface") + "/task_planner/spot_automaton_file_dump";
-			std::string command = python_executable + 
-				" " + formula2dfa_path + 
-				"/formula2dfa.py --dfa_path " + formula2dfa_path + "/dfas" + " " +
-				"--formulas " + formulaListToStr(req.formulas_ordered);
-			std::cout<<"COMMAND: "<<command<<std::endl;
-			int _ = system(command.c_str());
+		// The compact TS state ids are the node ids of ts_ptr
+		TS_EVAL<State>* tsEval() {
+			if (!env->ts_eval_ready) {
+				std::cout<<"Restoring the TS_EVAL of the transition system for SymbSearch"<<std::endl;
+				compact_ts->restore(env->ts_eval, SS, env->ts_eval_states);
+				env->ts_eval_ready = true;
+			}
+			return ts_ptr;
+		}
 
-			std::string dfa_filename_path_prefix = ros::package::getPath("manipulation_interface") + "/task_planner/spot_automaton_file_dump/dfas/";
+		// Object dimensions no proposition of the DFAs refers to. The
+		// conditions treat every object alike, so these objects can be
+		// permuted without changing a plan's length or formula costs
+		void interchangeableDims(const StateEncoding& encoding, const std::vector<const DenseDFA*>& dense_dfas, std::vector<int>& dims) const {
+			dims.clear();
+			if (!use_symmetry_reduction) {
+				return;
+			}
+			for (auto& obj : obj_group) {
+				const std::string prefix = obj + "_";
+				bool mentioned = false;
+				for (auto dense_dfa : dense_dfas) {
+					for (auto& ap : dense_dfa->getAP()) {
+						mentioned = mentioned || ap.compare(0, prefix.size(), prefix) == 0;
+					}
+				}
+				if (!mentioned) {
+					dims.push_back(encoding.dimIndex(obj));
+				}
+			}
+		}
+
+		// TS state with these object and end effector locations (the initial
+		// ones where empty), not holding anything. -1 if the TS does not have it
+		int findStartState(const std::vector<std::string>& obj_locations, const std::string& ee_location) {
+			const StateEncoding& encoding = lazy_ts ? lazy_ts->getEncoding() : compact_ts->getEncoding();
+			PackedState s = lazy_ts ? lazy_ts->getState(lazy_ts->getInitState()) : compact_ts->getState(compact_ts->getInitState());
+			std::vector<std::pair<std::string, std::string>> dim_labels;
+			if (!obj_locations.empty()) {
+				if (obj_locations.size() != obj_group.size()) {
+					return -1;
+				}
+				for (int i=0; i<obj_group.size(); ++i) {
+					dim_labels.push_back({obj_group[i], obj_locations[i]});
+				}
+			}
+			if (!ee_location.empty()) {
+				dim_labels.push_back({"eeLoc", ee_location});
+			}
+			for (auto& dim_label : dim_labels) {
+				const int dim = encoding.dimIndex(dim_label.first);
+				const int label_ind = (dim >= 0) ? encoding.labelIndex(dim, dim_label.second) : -1;
+				if (label_ind < 0) {
+					return -1;
+				}
+				encoding.set(s, dim, label_ind);
+			}
+			return product_search.stateId(s);
+		}
 
-			std::vector<DFA> dfa_arr(N_DFAs);
-			std::vector<std::string> filenames(N_DFAs);
-			for (int i=0; i<N_DFAs; ++i) {
-				filenames[i] = dfa_filename_path_prefix +"dfa_" + std::to_string(i) +".txt";
+		// TS state id of a state of a plan, -1 if the TS does not have it
+		int stateId(const State* state) {
+			const StateEncoding& encoding = lazy_ts ? lazy_ts->getEncoding() : compact_ts->getEncoding();
+			std::vector<std::string> labels;
+			for (auto& dim_name : encoding.getDimNames()) {
+				labels.push_back(state->getVar(dim_name));
 			}
-			for (int i=0; i<N_DFAs; ++i) {
-				dfa_arr[i].readFileSingle(filenames[i]);
+			PackedState s;
+			return encoding.encode(labels, s) ? product_search.stateId(s) : -1;
+		}
+
+		// Plans again from the k-th state of the last plan after the action out
+		// of it failed, with the formulas in the states the executed actions
+		// (of this plan and of those it replaced) left them in. The new plan
+		// replaces the last one
+		bool replan(int k) {
+			const auto stop_time = stopTime(plan_deadline);
+			std::vector<const DenseDFA*> dense_dfas;
+			if (!use_product_search || !getDenseDFAs(plan_formulas, stop_time, dense_dfas)) {
+				return false;
+			}
+			std::vector<int> path = plan_prefix;
+			for (int j=0; j<=k; ++j) {
+				const int state = stateId(plan_states[j]);
+				if (state < 0) {
+					return false;
+				}
+				path.push_back(state);
 			}
-			std::cout<<"\n\nPrinting all DFA's (read into an array)...\n\n"<<std::endl;
-			for (int i=0; i<N_DFAs; ++i) {
-				dfa_arr[i].print();
-				std::cout<<"\n"<<std::endl;
+			Plan result;
+			product_search.setStartPath(path);
+			productPlan(product_search, dense_dfas, plan_flexibility, stop_time, result);
+			product_search.setStartPath({});
+			product_search.print();
+			if (!result.success) {
+				return false;
 			}
+			path.pop_back();
+			plan_prefix = path;
+			plan_states = result.states;
+			plan_actions = result.actions;
+			return true;
+		}
 
+		PackedState packedState(int state) const {
+			return lazy_ts ? lazy_ts->getState(state) : compact_ts->getState(state);
+		}
 
+		// Key of a plan() query in the plan cache
+		std::string planKey(const std::vector<std::string>& formulas_ordered, int start_state, float flexibility) const {
+			std::vector<std::string> formulas;
+			for (auto& formula : formulas_ordered) {
+				formulas.push_back(DFACache::normalize(formula));
+			}
+			return PlanCache::makeKey(env->ts_key, packedState(start_state), formulas, flexibility);
+		}
+
+		// False on a miss, or if a state of the cached plan is not in the TS
+		bool cachedPlan(const std::string& key, Plan& result) {
+			const PlanCache::Entry* entry = plan_cache->find(key);
+			if (!entry) {
+				return false;
+			}
+			Plan cached;
+			cached.success = entry->success;
+			cached.pathlength = entry->path_length;
+			cached.formula_costs = entry->cost_vector;
+			cached.suboptimality = entry->suboptimality;
+			cached.actions = entry->action_sequence;
+			for (auto& s : entry->state_sequence) {
+				const int state = product_search.stateId(s);
+				if (state < 0) {
+					return false;
+				}
+				cached.state_ids.push_back(state);
+				cached.states.push_back(getState(state));
+			}
+			result = std::move(cached);
+			return true;
+		}
+
+		void cachePlan(const std::string& key, const Plan& result) {
+			PlanCache::Entry entry;
+			entry.success = result.success;
+			entry.path_length = result.pathlength;
+			entry.cost_vector = result.formula_costs;
+			entry.suboptimality = result.suboptimality;
+			entry.action_sequence = result.actions;
+			for (auto state : result.state_ids) {
+				entry.state_sequence.push_back(packedState(state));
+			}
+			plan_cache->insert(key, entry);
+		}
+
+		// Absolute stop time of a query, max() for a deadline of 0. Every stage
+		// of the query is bounded by the same one
+		static std::chrono::steady_clock::time_point stopTime(double deadline) {
+			if (deadline <= 0.0) {
+				return std::chrono::steady_clock::time_point::max();
+			}
+			return std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(deadline));
+		}
+
+		const std::string& actionLabel(int action) const {
+			return lazy_ts ? lazy_ts->actionLabel(action) : compact_ts->actionLabel(action);
+		}
+
+		// Fills in the state ids and actions but not the decoded states. Only
+		// reads the generated transition systems, so without a lazy TS it can
+		// run on any worker with its own ProductSearch
+		void productSearchPlan(ProductSearch& search, const std::vector<const DenseDFA*>& dense_dfas, float flexibility, std::chrono::steady_clock::time_point stop_time, Plan& result) const {
+			std::vector<int> sym_dims;
+			interchangeableDims(lazy_ts ? lazy_ts->getEncoding() : compact_ts->getEncoding(), dense_dfas, sym_dims);
+			search.setInterchangeable(sym_dims);
+			search.setStopTime(stop_time);
+			search.setAutomata(dense_dfas);
+			search.setFlexibility(flexibility);
+			result.success = search.search();
+			result.pathlength = search.getPathLength();
+			result.formula_costs = search.getCostVector();
+			result.complete = search.getComplete();
+			result.suboptimality = search.getSuboptimality();
+			result.state_ids = search.getStateSequence();
+			for (auto action : search.getActionSequence()) {
+				result.actions.push_back(actionLabel(action));
+			}
+		}
+
+		// getState() caches what it decodes, so this only runs on the calling thread
+		void decodeStates(Plan& result) {
+			result.states.clear();
+			for (auto state : result.state_ids) {
+				result.states.push_back(getState(state));
+			}
+		}
+
+		void productPlan(ProductSearch& search, const std::vector<const DenseDFA*>& dense_dfas, float flexibility, std::chrono::steady_clock::time_point stop_time, Plan& result) {
+			productSearchPlan(search, dense_dfas, flexibility, stop_time, result);
+			decodeStates(result);
+		}
+
+		// Plans over the abstract TS and refines the plan, false if there is no
+		// abstract plan or the refined one does not keep its formula costs
+		bool hierarchicalPlan(const std::vector<const DenseDFA*>& dense_dfas, float flexibility, std::chrono::steady_clock::time_point stop_time, Plan& result) {
+			if (!hierarchical_search) {
+				return false;
+			}
+			std::vector<int> sym_dims;
+			interchangeableDims(hierarchical_search->getAbstractEncoding(), dense_dfas, sym_dims);
+			hierarchical_search->setInterchangeable(sym_dims);
+			hierarchical_search->setStopTime(stop_time);
+			hierarchical_search->setAutomata(dense_dfas);
+			hierarchical_search->setFlexibility(flexibility);
+			const bool refined = hierarchical_search->search();
+			hierarchical_search->print();
+			if (!refined) {
+				ROS_WARN("No refined abstract plan, planning over the full transition system");
+				return false;
+			}
+			result.success = true;
+			result.pathlength = hierarchical_search->getPathLength();
+			result.formula_costs = hierarchical_search->getCostVector();
+			result.complete = hierarchical_search->getComplete();
+			result.suboptimality = hierarchical_search->getSuboptimality();
+			result.state_ids = hierarchical_search->getStateSequence();
+			for (auto state : result.state_ids) {
+				result.states.push_back(getState(state));
+			}
+			for (auto action : hierarchical_search->getActionSequence()) {
+				result.actions.push_back(actionLabel(action));
+			}
+			return true;
+		}
+
+		void symbSearchPlan(const std::vector<DFA*>& dfa_arr, float flexibility, Plan& result) {
+			clearDFAPtrs();
 
 			/////////////////////////////////////////////////
 			/*        Construct the Symbolic Search        */
@@ -77,37 +407,285 @@ class PlanSrv {
 			// First construct the graph evaluation objects:
 			//TS_EVAL<State> ts_eval(&ts, 0); 
 			//std::vector<DFA_EVAL> dfa_eval_vec;
-			for (int i=0; i<N_DFAs; ++i) {
-				DFA_EVAL* temp_dfa_eval_ptr = new DFA_EVAL(&dfa_arr[i]);
+			for (int i=0; i<dfa_arr.size(); ++i) {
+				DFA_EVAL* temp_dfa_eval_ptr = new DFA_EVAL(dfa_arr[i]);
 				dfa_eval_ptrs.push_back(temp_dfa_eval_ptr);
 			}
 
 			search_obj.setAutomataPrefs(&dfa_eval_ptrs);
-			search_obj.setTransitionSystem(ts_ptr);
+			search_obj.setTransitionSystem(tsEval());
+
+
+			search_obj.setFlexibilityParam(flexibility);
+
+			std::pair<bool, float> search_result = search_obj.search(true); // Use heuristic
+			result.success = search_result.first;
+			result.pathlength = search_result.second;
+			auto state_sequence = search_obj.getStateSequence();
+			auto action_sequence = search_obj.getActionSequence();
+			result.states.assign(state_sequence.begin(), state_sequence.end());
+			result.actions.assign(action_sequence.begin(), action_sequence.end());
+		}
 
+		// Plans over 'env_' from then on. The searches start over and the last
+		// plan is dropped, its states belong to the previous environment
+		// Same heuristics and accept table budget for every product search over
+		// the environment, the worker pool is only given to product_search
+		void configureSearch(ProductSearch& search) const {
+			search.setPatternDB(pattern_db);
+			search.setAcceptTableSize(std::max(accept_table_size, 0));
+		}
+
+		void setEnvironment(std::unique_ptr<Environment> env_) {
+			clearDFAPtrs();
+			plan_states.clear();
+			plan_actions.clear();
+			decoded_states.clear();
+			batch_searches.clear();
+			env = std::move(env_);
+			ts_ptr = &env->ts_eval;
+			compact_ts = &env->compact_ts;
+			lazy_ts = env->lazy_ts.get();
+			pattern_db = env->pattern_db_ready ? &env->pattern_db : nullptr;
+			SS = &env->SS_MANIPULATOR;
+			hierarchical_search = use_product_search ? env->hierarchical_search.get() : nullptr;
+			symbolic_ts = env->symbolic_ts.get();
+			obj_group = env->obj_group;
+			product_search = lazy_ts ? ProductSearch(lazy_ts) : ProductSearch(compact_ts);
+			configureSearch(product_search);
+			// The batch searches run on the pool, so only this one may use it
+			if (use_parallel_search) {
+				product_search.setWorkerPool(pool);
+			}
+		}
+	public:
+		PlanSrv(std::unique_ptr<Environment> env_, DFACache* dfa_cache_, PlanCache* plan_cache_, bool use_product_search_, bool use_symmetry_reduction_, bool use_parallel_search_, int accept_table_size_, int max_replans_, WorkerPool* pool_, ros::NodeHandle* current_NH_, ros::NodeHandle* private_NH_) : 
+			dfa_cache(dfa_cache_),
+			plan_cache(plan_cache_),
+			product_search(&env_->compact_ts),
+			use_product_search(use_product_search_),
+			use_symmetry_reduction(use_symmetry_reduction_),
+			use_parallel_search(use_parallel_search_),
+			accept_table_size(accept_table_size_),
+			max_replans(max_replans_),
+			pool(pool_),
+			current_NH(current_NH_),
+			private_NH(private_NH_),
+			plan_flexibility(0.0f),
+			plan_deadline(0.0f) {
+				setEnvironment(std::move(env_));
+			}
+		bool plan(manipulation_interface::PreferenceQuery::Request& req, manipulation_interface::PreferenceQuery::Response& res) {
+			plan_states.clear();
+			plan_actions.clear();
+			// Translation counts against the deadline, a worker translation still
+			// running at the stop time fails the query
+			const auto stop_time = stopTime(req.deadline);
 
-			search_obj.setFlexibilityParam(req.flexibility);
+			std::vector<DFA*> dfa_arr;
+			if (!getDFAs(req.formulas_ordered, stop_time, dfa_arr)) {
+				res.success = false;
+				res.pathlength = 0.0f;
+				res.complete = true;
+				res.suboptimality_bound = 1.0f;
+				return true;
+			}
+			dfa_cache->printStats();
 
-			std::pair<bool, float> result = search_obj.search(true); // Use heuristic
-			res.success = result.first;
-			res.pathlength = result.second;
+			Plan result;
+			std::vector<const DenseDFA*> dense_dfas;
+			const bool dense = use_product_search && getDenseDFAs(req.formulas_ordered, stop_time, dense_dfas);
+			// The symbolic TS, the abstract TS and SymbSearch start from the initial state
+			const int init_state = lazy_ts ? lazy_ts->getInitState() : compact_ts->getInitState();
+			int start_state = init_state;
+			if (!req.obj_locations.empty() || !req.ee_location.empty()) {
+				start_state = findStartState(req.obj_locations, req.ee_location);
+				if (start_state < 0) {
+					ROS_ERROR("Current locations are not a state of the transition system");
+				} else if (start_state != init_state && !dense) {
+					ROS_ERROR("Planning from the current locations needs every DFA as a dense table");
+				}
+				if (start_state < 0 || (start_state != init_state && !dense)) {
+					res.success = false;
+					res.pathlength = 0.0f;
+					res.complete = true;
+					res.suboptimality_bound = 1.0f;
+					return true;
+				}
+			}
+			// Only complete plans are cached, so a hit does not depend on the deadline
+			const std::string plan_key = (dense && plan_cache->enabled()) ? planKey(req.formulas_ordered, start_state, req.flexibility) : std::string();
+			if (!plan_key.empty() && cachedPlan(plan_key, result)) {
+				ROS_INFO("Plan cache hit");
+			} else if (dense) {
+				if (start_state != init_state) {
+					product_search.setStartState(start_state);
+					productPlan(product_search, dense_dfas, req.flexibility, stop_time, result);
+					product_search.print();
+					product_search.setStartState(-1);
+				} else if (symbolic_ts && !symbolic_ts->canAccept(dense_dfas, stop_time)) {
+					// Over a lazy TS the product search would have to expand every reachable state to find out
+					ROS_WARN("No path of the transition system satisfies the formulas");
+				} else if (!hierarchicalPlan(dense_dfas, req.flexibility, stop_time, result)) {
+					productPlan(product_search, dense_dfas, req.flexibility, stop_time, result);
+					product_search.print();
+				}
+				if (lazy_ts) {
+					lazy_ts->print();
+				}
+				if (!plan_key.empty() && result.complete) {
+					cachePlan(plan_key, result);
+				}
+			} else if (lazy_ts) {
+				// The lazy TS is only searched by the product search
+				ROS_ERROR("Lazy transition system needs every DFA as a dense table");
+			} else {
+				// SymbSearch cannot be interrupted
+				if (req.deadline > 0.0f) {
+					ROS_WARN("Deadline is only met by the product search, running SymbSearch to completion");
+				}
+				symbSearchPlan(dfa_arr, req.flexibility, result);
+			}
+			if (!plan_key.empty()) {
+				plan_cache->printStats();
+				private_NH->setParam("plan_cache_hit_rate", plan_cache->hitRate());
+			}
+			res.success = result.success;
+			res.pathlength = result.pathlength;
+			res.complete = result.complete;
+			res.suboptimality_bound = result.suboptimality;
+			plan_states = result.states;
+			plan_actions = result.actions;
+			plan_formulas = req.formulas_ordered;
+			plan_flexibility = req.flexibility;
+			plan_deadline = req.deadline;
+			plan_prefix.clear();
+			return true;
+		}
+
+		// Plans every preference set of the batch, the product searches run
+		// concurrently on the worker pool. DFAs are looked up beforehand since
+		// the cache is not thread safe, and the plan states are decoded and
+		// sets that need SymbSearch planned serially afterwards. A lazy TS grows while it is searched,
+		// so over one the sets are planned serially. The plan sent by run() is
+		// not changed
+		bool batchPlan(manipulation_interface::BatchPreferenceQuery::Request& req, manipulation_interface::BatchPreferenceQuery::Response& res) {
+			const int n_sets = req.preference_sets.size();
+			std::vector<Plan> results(n_sets);
+			std::vector<std::vector<DFA*>> dfa_arrs(n_sets);
+			std::vector<std::vector<const DenseDFA*>> dense_dfa_arrs(n_sets);
+			std::vector<char> valid(n_sets), dense(n_sets);
+			for (int i=0; i<n_sets; ++i) {
+				const std::vector<std::string>& formulas_ordered = req.preference_sets[i].formulas_ordered;
+				valid[i] = getDFAs(formulas_ordered, std::chrono::steady_clock::time_point::max(), dfa_arrs[i]);
+				dense[i] = valid[i] && use_product_search && getDenseDFAs(formulas_ordered, std::chrono::steady_clock::time_point::max(), dense_dfa_arrs[i]);
+			}
+			dfa_cache->printStats();
+
+			if (lazy_ts) {
+				for (int i=0; i<n_sets; ++i) {
+					if (dense[i]) {
+						productPlan(product_search, dense_dfa_arrs[i], req.preference_sets[i].flexibility, std::chrono::steady_clock::time_point::max(), results[i]);
+					}
+				}
+			} else {
+				while (batch_searches.size() < pool->size()) {
+					batch_searches.emplace_back(compact_ts);
+					configureSearch(batch_searches.back());
+				}
+				pool->parallelFor(n_sets, 1, [&](int worker, size_t begin, size_t end) {
+					for (size_t i=begin; i<end; ++i) {
+						if (dense[i]) {
+							productSearchPlan(batch_searches[worker], dense_dfa_arrs[i], req.preference_sets[i].flexibility, std::chrono::steady_clock::time_point::max(), results[i]);
+						}
+					}
+				});
+				for (int i=0; i<n_sets; ++i) {
+					decodeStates(results[i]);
+				}
+			}
+			for (int i=0; i<n_sets; ++i) {
+				if (valid[i] && !dense[i] && !lazy_ts) {
+					symbSearchPlan(dfa_arrs[i], req.preference_sets[i].flexibility, results[i]);
+				}
+			}
+
+			res.results.resize(n_sets);
+			int n_success = 0;
+			for (int i=0; i<n_sets; ++i) {
+				res.results[i].success = results[i].success;
+				res.results[i].pathlength = results[i].pathlength;
+				res.results[i].formula_costs = results[i].formula_costs;
+				res.results[i].action_sequence = results[i].actions;
+				n_success += results[i].success;
+			}
+			ROS_INFO("Batch planning: %d of %d preference sets succeeded", n_success, n_sets);
+			return true;
+		}
+
+		// Every plan the flexibility selects over [min_flexibility,
+		// max_flexibility], from a single product search up to max_flexibility.
+		// flexibility[i] is the smallest flexibility that selects front[i]
+		bool sweep(manipulation_interface::FlexibilitySweepQuery::Request& req, manipulation_interface::FlexibilitySweepQuery::Response& res) {
+			res.success = false;
+			std::vector<DFA*> dfa_arr;
+			std::vector<const DenseDFA*> dense_dfas;
+			if (!getDFAs(req.formulas_ordered, std::chrono::steady_clock::time_point::max(), dfa_arr)) {
+				return true;
+			}
+			if (!getDenseDFAs(req.formulas_ordered, std::chrono::steady_clock::time_point::max(), dense_dfas)) {
+				ROS_ERROR("Flexibility sweep needs every DFA as a dense table");
+				return true;
+			}
+			std::vector<int> sym_dims;
+			interchangeableDims(lazy_ts ? lazy_ts->getEncoding() : compact_ts->getEncoding(), dense_dfas, sym_dims);
+			product_search.setInterchangeable(sym_dims);
+			product_search.setStopTime(std::chrono::steady_clock::time_point::max());
+			product_search.setAutomata(dense_dfas);
+			product_search.setFlexibility(req.max_flexibility);
+			res.success = product_search.search();
+			product_search.print();
+
+			std::vector<ProductSearch::FrontPoint> front;
+			product_search.getFront(front);
+			for (int i=0; i<front.size(); ++i) {
+				// Points superseded before min_flexibility are not selectable in the range
+				if (i + 1 < front.size() && front[i + 1].flexibility <= req.min_flexibility) {
+					continue;
+				}
+				manipulation_interface::PlanResult result;
+				result.success = true;
+				result.pathlength = front[i].path_length;
+				result.formula_costs = front[i].cost_vector;
+				for (auto action : front[i].action_sequence) {
+					result.action_sequence.push_back(actionLabel(action));
+				}
+				res.flexibility.push_back(front[i].flexibility);
+				res.front.push_back(result);
+			}
+			ROS_INFO("Flexibility sweep: %lu plans over [%f, %f]", res.front.size(), req.min_flexibility, req.max_flexibility);
 			return true;
 		}
 
 		bool run(manipulation_interface::RunQuery::Request& req, manipulation_interface::RunQuery::Response& res) {
-			auto state_sequence = search_obj.getStateSequence();
-			auto action_sequence = search_obj.getActionSequence();
+			const std::vector<const State*>& state_sequence = plan_states;
+			const std::vector<std::string>& action_sequence = plan_actions;
 
 			ros::ServiceClient ex_client = current_NH->serviceClient<manipulation_interface::ActionSingle>("/action_primitive");
 			manipulation_interface::ActionSingle action_single;
 
 			action_single.request.obj_group = obj_group;
-			std::vector<std::string> init_obj_locs;
-			const State* init_state_ptr = ts_ptr->getState(ts_ptr->getInitStateInd());
-			for (auto& obj : obj_group) {
-				init_obj_locs.push_back(init_state_ptr->getVar(obj));
-			}
-			action_single.request.init_obj_locs = init_obj_locs;
+			// The plan may start away from the initial state
+			auto setInitObjLocs = [&](const State* init_state_ptr) {
+				std::vector<std::string> init_obj_locs;
+				for (auto& obj : obj_group) {
+					init_obj_locs.push_back(init_state_ptr->getVar(obj));
+				}
+				action_single.request.init_obj_locs = init_obj_locs;
+			};
+			setInitObjLocs(!state_sequence.empty() ? state_sequence[0] : getState(lazy_ts ? lazy_ts->getInitState() : compact_ts->getInitState()));
+
+			int n_replans = 0;
 
 			for (int i=0; i<action_sequence.size(); ++i) {
 				std::cout<<"Sending action:" + action_sequence[i]<<std::endl;
@@ -141,6 +719,13 @@ class PlanSrv {
 				} else {
 					ROS_ERROR("Execution client call failed!");
 					res.success = false;
+					// Carry on with a plan from the last state reached
+					if (n_replans < max_replans && replan(i)) {
+						ROS_WARN("Replanned from the last state reached (%d of %d replans)", ++n_replans, max_replans);
+						setInitObjLocs(state_sequence[0]);
+						i = -1;
+						continue;
+					}
 					break;
 				}
 			}
@@ -148,6 +733,62 @@ class PlanSrv {
 			return true; // Success in the response allows for failed actions, thus failed execution
 		}
 
+		// Adds locations, and objects at free locations, to the environment on
+		// the parameter server and plans over the transition systems built for
+		// it from then on (restored from their snapshots for environments seen
+		// before). The current environment is kept if the new one can not be
+		// built
+		bool extendEnvironment(manipulation_interface::ExtendEnvironment::Request& req, manipulation_interface::ExtendEnvironment::Response& res) {
+			res.success = false;
+			res.n_states = 0;
+			auto contains = [](const std::vector<std::string>& labels, const std::string& label) {
+				return std::find(labels.begin(), labels.end(), label) != labels.end();
+			};
+			std::vector<std::string> new_obj_group = env->obj_group;
+			std::vector<std::string> new_loc_labels = env->loc_labels;
+			std::vector<std::string> new_init_obj_locations = env->init_obj_locations;
+			for (auto& loc : req.new_locations) {
+				if (loc.empty() || loc == "ee" || loc == "stow" || contains(new_loc_labels, loc)) {
+					ROS_ERROR("Location %s is reserved or already in the environment", loc.c_str());
+					return true;
+				}
+				new_loc_labels.push_back(loc);
+			}
+			if (req.new_objects.size() != req.new_obj_locations.size()) {
+				ROS_ERROR("Every new object needs one location");
+				return true;
+			}
+			for (int i=0; i<req.new_objects.size(); ++i) {
+				if (req.new_objects[i].empty() || contains(new_obj_group, req.new_objects[i])) {
+					ROS_ERROR("Object %s is already in the environment", req.new_objects[i].c_str());
+					return true;
+				}
+				if (!contains(new_loc_labels, req.new_obj_locations[i]) || contains(new_init_obj_locations, req.new_obj_locations[i])) {
+					ROS_ERROR("Location %s of object %s is unknown or taken", req.new_obj_locations[i].c_str(), req.new_objects[i].c_str());
+					return true;
+				}
+				new_obj_group.push_back(req.new_objects[i]);
+				new_init_obj_locations.push_back(req.new_obj_locations[i]);
+			}
+
+			current_NH->setParam("/discrete_environment/obj_group", new_obj_group);
+			current_NH->setParam("/discrete_environment/location_names", new_loc_labels);
+			current_NH->setParam("/discrete_environment/init_obj_locations", new_init_obj_locations);
+			std::unique_ptr<Environment> new_env(new Environment);
+			if (!buildEnvironment(*new_env, *current_NH, *private_NH, *pool)) {
+				ROS_ERROR("Could not build the extended environment, keeping the current one");
+				current_NH->setParam("/discrete_environment/obj_group", env->obj_group);
+				current_NH->setParam("/discrete_environment/location_names", env->loc_labels);
+				current_NH->setParam("/discrete_environment/init_obj_locations", env->init_obj_locations);
+				return true;
+			}
+			setEnvironment(std::move(new_env));
+			res.success = true;
+			res.n_states = lazy_ts ? lazy_ts->size() : compact_ts->size();
+			ROS_INFO("Environment extended to %lu objects and %lu locations", obj_group.size(), env->loc_labels.size());
+			return true;
+		}
+
 		void clearDFAPtrs() {
 			for (int i=0; i<dfa_eval_ptrs.size(); ++i) {
 				delete dfa_eval_ptrs[i];
@@ -161,12 +802,22 @@ class PlanSrv {
 
 };
 
-int main(int argc, char** argv) {
-	ros::init(argc, argv, "planner_node");
-	ros::NodeHandle planner_NH;
+// Conditions do not serialize, so their printout is what identifies them in
+// the transition system snapshot key
+std::string conditionSignature(const Condition& cond) {
+	std::stringstream ss;
+	std::streambuf* cout_buf = std::cout.rdbuf(ss.rdbuf());
+	cond.print();
+	std::cout.rdbuf(cout_buf);
+	return ss.str();
+}
 
+// Builds the state space, the conditions and the transition systems of the
+// discrete environment on the parameter server, false if one of them could
+// not be set up
+bool buildEnvironment(Environment& env, ros::NodeHandle& planner_NH, ros::NodeHandle& planner_private_NH, WorkerPool& worker_pool) {
     // Object group:
-    std::vector<std::string> obj_group;
+    std::vector<std::string>& obj_group = env.obj_group;
     planner_NH.getParam("/discrete_environment/obj_group", obj_group);
     std::cout<<"Found "<<obj_group.size()<<" objects: ";
     for (auto& obj : obj_group) {
@@ -175,11 +826,11 @@ int main(int argc, char** argv) {
 	std::cout<<"\n";
 
     // Location names:
-    std::vector<std::string> loc_labels;
+    std::vector<std::string>& loc_labels = env.loc_labels;
     planner_NH.getParam("/discrete_environment/location_names", loc_labels);
 
     // Initial object locations:
-    std::vector<std::string> init_obj_locations;
+    std::vector<std::string>& init_obj_locations = env.init_obj_locations;
     planner_NH.getParam("/discrete_environment/init_obj_locations", init_obj_locations);
 
 	//////////////////////////////////////////////////////
@@ -187,7 +838,7 @@ int main(int argc, char** argv) {
 	//////////////////////////////////////////////////////
 
 	/* CREATE ENVIRONMENT FOR MANIPULATOR */
-	StateSpace SS_MANIPULATOR;
+	StateSpace& SS_MANIPULATOR = env.SS_MANIPULATOR;
 
     // Properties of the planning environment:
 	std::vector<std::string> set_state = {"stow"};
@@ -221,104 +872,403 @@ int main(int argc, char** argv) {
 	SS_MANIPULATOR.setLabelGroup("object locations", obj_group);
 
 	// Set the initial state:
-	State init_state(&SS_MANIPULATOR);	
-	init_state.setState(set_state);
+	env.init_state.reset(new State(&SS_MANIPULATOR));
+	env.init_state->setState(set_state);
 
 	/* SET CONDITIONS */
-	// Pickup domain conditions:
-	std::vector<Condition> conds_m;
-	std::vector<Condition*> cond_ptrs_m;
+	// Pickup domain conditions, recorded once and exported to the
+	// interpreted Conditions used by TS_EVAL:
+	std::vector<CompiledCondition> compiled_conds_m;
+	std::vector<Condition>& conds_m = env.conds_m;
+	std::vector<Condition*>& cond_ptrs_m = env.cond_ptrs_m;
+	compiled_conds_m.resize(4);
 	conds_m.resize(4);
 	cond_ptrs_m.resize(4);
 
 	// Grasp 
-	conds_m[0].addCondition(Condition::PRE, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "false");
-	conds_m[0].addCondition(Condition::PRE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::LABEL, "eeLoc",Condition::TRUE, "arg");
-	conds_m[0].setCondJunctType(Condition::PRE, Condition::CONJUNCTION);
+	compiled_conds_m[0].addCondition(Condition::PRE, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "false");
+	compiled_conds_m[0].addCondition(Condition::PRE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::LABEL, "eeLoc",Condition::TRUE, "arg");
+	compiled_conds_m[0].setCondJunctType(Condition::PRE, Condition::CONJUNCTION);
 
-	conds_m[0].addCondition(Condition::POST, Condition::ARG_L, Condition::FILLER, Condition::ARG_EQUALS, Condition::VAR, "ee",Condition::TRUE, "arg");
-	conds_m[0].addCondition(Condition::POST, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "true");
-	conds_m[0].setCondJunctType(Condition::POST, Condition::CONJUNCTION);
-	conds_m[0].setActionLabel("grasp");
-	conds_m[0].setActionCost(0);
+	compiled_conds_m[0].addCondition(Condition::POST, Condition::ARG_L, Condition::FILLER, Condition::ARG_EQUALS, Condition::VAR, "ee",Condition::TRUE, "arg");
+	compiled_conds_m[0].addCondition(Condition::POST, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "true");
+	compiled_conds_m[0].setCondJunctType(Condition::POST, Condition::CONJUNCTION);
+	compiled_conds_m[0].setActionLabel("grasp");
+	compiled_conds_m[0].setActionCost(0);
 
 	// Transport 
-	conds_m[1].addCondition(Condition::PRE, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "true");
-	conds_m[1].addCondition(Condition::PRE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::LABEL, "eeLoc", Condition::NEGATE, "arg1");
-	conds_m[1].addCondition(Condition::PRE, Condition::LABEL, "eeLoc", Condition::ARG_FIND, Condition::NONE, Condition::FILLER, Condition::TRUE, "arg2");
-	conds_m[1].setCondJunctType(Condition::PRE, Condition::CONJUNCTION); // Used to store eeLoc pre-state variable
-	conds_m[1].addCondition(Condition::POST, Condition::ARG_V, Condition::FILLER, Condition::ARG_EQUALS, Condition::LABEL, "eeLoc", Condition::NEGATE, "arg2"); // Stored eeLoc pre-state variable is not the same as post-state eeLoc (eeLoc has moved)
-	conds_m[1].addCondition(Condition::POST, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::LABEL, "eeLoc", Condition::NEGATE,"na");
-	conds_m[1].setCondJunctType(Condition::POST, Condition::CONJUNCTION);
-	conds_m[1].setActionLabel("transport");
-	conds_m[1].setActionCost(5);
+	compiled_conds_m[1].addCondition(Condition::PRE, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "true");
+	compiled_conds_m[1].addCondition(Condition::PRE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::LABEL, "eeLoc", Condition::NEGATE, "arg1");
+	compiled_conds_m[1].addCondition(Condition::PRE, Condition::LABEL, "eeLoc", Condition::ARG_FIND, Condition::NONE, Condition::FILLER, Condition::TRUE, "arg2");
+	compiled_conds_m[1].setCondJunctType(Condition::PRE, Condition::CONJUNCTION); // Used to store eeLoc pre-state variable
+	compiled_conds_m[1].addCondition(Condition::POST, Condition::ARG_V, Condition::FILLER, Condition::ARG_EQUALS, Condition::LABEL, "eeLoc", Condition::NEGATE, "arg2"); // Stored eeLoc pre-state variable is not the same as post-state eeLoc (eeLoc has moved)
+	compiled_conds_m[1].addCondition(Condition::POST, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::LABEL, "eeLoc", Condition::NEGATE,"na");
+	compiled_conds_m[1].setCondJunctType(Condition::POST, Condition::CONJUNCTION);
+	compiled_conds_m[1].setActionLabel("transport");
+	compiled_conds_m[1].setActionCost(5);
 	//conds_m[1].print();
 
 	// Release 
-	conds_m[2].addCondition(Condition::PRE, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "true");
-	conds_m[2].addCondition(Condition::PRE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::LABEL, "eeLoc", Condition::NEGATE, "arg1");
-	conds_m[2].addCondition(Condition::PRE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::VAR, "ee",Condition::TRUE, "arg2");
-	conds_m[2].setCondJunctType(Condition::PRE, Condition::CONJUNCTION);
-
-	conds_m[2].addCondition(Condition::POST, Condition::ARG_L, Condition::FILLER, Condition::ARG_EQUALS, Condition::LABEL, "eeLoc", Condition::TRUE, "arg2");
-	conds_m[2].addCondition(Condition::POST, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "false");
-	conds_m[2].setCondJunctType(Condition::POST, Condition::CONJUNCTION);
-	conds_m[2].setActionLabel("release");
-	conds_m[2].setActionCost(0);
+	compiled_conds_m[2].addCondition(Condition::PRE, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "true");
+	compiled_conds_m[2].addCondition(Condition::PRE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::LABEL, "eeLoc", Condition::NEGATE, "arg1");
+	compiled_conds_m[2].addCondition(Condition::PRE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::VAR, "ee",Condition::TRUE, "arg2");
+	compiled_conds_m[2].setCondJunctType(Condition::PRE, Condition::CONJUNCTION);
+
+	compiled_conds_m[2].addCondition(Condition::POST, Condition::ARG_L, Condition::FILLER, Condition::ARG_EQUALS, Condition::LABEL, "eeLoc", Condition::TRUE, "arg2");
+	compiled_conds_m[2].addCondition(Condition::POST, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "false");
+	compiled_conds_m[2].setCondJunctType(Condition::POST, Condition::CONJUNCTION);
+	compiled_conds_m[2].setActionLabel("release");
+	compiled_conds_m[2].setActionCost(0);
 	//conds_m[2].print();
 
 
 	// Transit
-	conds_m[3].addCondition(Condition::PRE, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "false");
-	conds_m[3].addCondition(Condition::PRE, Condition::LABEL, "eeLoc", Condition::ARG_FIND, Condition::NONE, Condition::FILLER, Condition::TRUE, "arg");
-	conds_m[3].setCondJunctType(Condition::PRE, Condition::CONJUNCTION);
-
-	conds_m[3].addCondition(Condition::POST, Condition::ARG_V, Condition::FILLER, Condition::ARG_EQUALS, Condition::LABEL, "eeLoc", Condition::NEGATE,"arg");
-	conds_m[3].setCondJunctType(Condition::POST, Condition::CONJUNCTION);
-	conds_m[3].setActionLabel("transit_up");
-	conds_m[3].setActionCost(0);
+	compiled_conds_m[3].addCondition(Condition::PRE, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "false");
+	compiled_conds_m[3].addCondition(Condition::PRE, Condition::LABEL, "eeLoc", Condition::ARG_FIND, Condition::NONE, Condition::FILLER, Condition::TRUE, "arg");
+	compiled_conds_m[3].setCondJunctType(Condition::PRE, Condition::CONJUNCTION);
+
+	compiled_conds_m[3].addCondition(Condition::POST, Condition::ARG_V, Condition::FILLER, Condition::ARG_EQUALS, Condition::LABEL, "eeLoc", Condition::NEGATE,"arg");
+	compiled_conds_m[3].setCondJunctType(Condition::POST, Condition::CONJUNCTION);
+	compiled_conds_m[3].setActionLabel("transit_up");
+	compiled_conds_m[3].setActionCost(0);
 	//conds_m[3].print();
 
 
 	for (int i=0; i<conds_m.size(); ++i){
+		compiled_conds_m[i].exportCondition(conds_m[i]);
 		cond_ptrs_m[i] = &conds_m[i];
 	}
 
 
 	/* Propositions */
 	std::cout<<"Setting Atomic Propositions... "<<std::endl;
-	std::vector<SimpleCondition> AP_m;
-	std::vector<SimpleCondition*> AP_m_ptrs;
+	std::vector<CompiledCondition> compiled_AP_m;
+	std::vector<SimpleCondition>& AP_m = env.AP_m;
+	std::vector<SimpleCondition*>& AP_m_ptrs = env.AP_m_ptrs;
 	for (auto& loc_label : loc_labels) {
         for (auto& obj : obj_group) {
-            SimpleCondition ap;
+            CompiledCondition ap;
             ap.addCondition(Condition::SIMPLE, Condition::LABEL, obj, Condition::EQUALS, Condition::VAR, loc_label);
             ap.addCondition(Condition::SIMPLE, Condition::LABEL, "holding", Condition::EQUALS, Condition::VAR, "false");
             ap.setCondJunctType(Condition::SIMPLE, Condition::CONJUNCTION);
             ap.setLabel(obj + "_" + loc_label);
-            AP_m.push_back(ap);
+            compiled_AP_m.push_back(ap);
         }
 	}
+	AP_m.resize(compiled_AP_m.size());
     AP_m_ptrs.resize(AP_m.size());
 	for (int i=0; i<AP_m.size(); ++i) {
+		compiled_AP_m[i].exportCondition(AP_m[i]);
 		AP_m_ptrs[i] = &AP_m[i];
 	}
 
 
 	// Create the transition system:
-	TS_EVAL<State> ts_eval(true, false, 0); // by default, the init node for the ts is 0
+	TS_EVAL<State>& ts_eval = env.ts_eval; // by default, the init node for the ts is 0
 
-	ts_eval.setInitState(&init_state);
+	ts_eval.setInitState(env.init_state.get());
 	ts_eval.setConditions(cond_ptrs_m);
 	ts_eval.setPropositions(AP_m_ptrs);
-	ts_eval.generate();
+
+	// The generated transition system is snapshotted, keyed by the
+	// environment and the conditions, so that restarts can skip generate():
+	bool use_ts_snapshot = true;
+	bool use_ts_generator = true;
+	bool use_compiled_conditions = true;
+	bool use_lazy_ts = false;
+	std::string ts_snapshot_dir = ros::package::getPath("manipulation_interface") + "/ts_snapshots";
+	planner_private_NH.getParam("use_ts_snapshot", use_ts_snapshot);
+	planner_private_NH.getParam("use_ts_generator", use_ts_generator);
+	planner_private_NH.getParam("use_compiled_conditions", use_compiled_conditions);
+	planner_private_NH.getParam("use_lazy_ts", use_lazy_ts);
+	planner_private_NH.getParam("ts_snapshot_dir", ts_snapshot_dir);
+
+	std::vector<std::string> dim_names = {"eeLoc"};
+	std::vector<std::vector<std::string>> dim_labels = {ee_labels};
+	for (auto& obj : obj_group) {
+		dim_names.push_back(obj);
+		dim_labels.push_back(obj_labels);
+	}
+	dim_names.push_back("holding");
+	dim_labels.push_back(grip_labels);
+	std::vector<std::string> AP_m_labels;
+	std::string ts_key_str;
+	for (int i=0; i<dim_names.size(); ++i) {
+		ts_key_str += dim_names[i] + ":";
+		for (auto& label : dim_labels[i]) {
+			ts_key_str += label + ",";
+		}
+		ts_key_str += "\n";
+	}
+	for (auto& label : set_state) {
+		ts_key_str += label + ",";
+	}
+	ts_key_str += "\n";
+	for (auto& cond : conds_m) {
+		ts_key_str += conditionSignature(cond);
+	}
+	for (auto& ap : AP_m) {
+		AP_m_labels.push_back(ap.getLabel());
+		ts_key_str += conditionSignature(ap);
+	}
+	const uint64_t ts_key = fnv1a(ts_key_str);
+	env.ts_key = ts_key;
+	std::stringstream snapshot_filename;
+	snapshot_filename<<ts_snapshot_dir<<"/ts_"<<std::hex<<std::setw(16)<<std::setfill('0')<<ts_key<<".bin";
+
+	// Symbolic TS, its reachable states are counted without enumerating them
+	// so that a TS too large to generate is planned over lazily instead
+	bool use_symbolic_ts = false;
+	int symbolic_node_limit = 1 << 24;
+	double lazy_ts_threshold = 0.0;
+	planner_private_NH.getParam("use_symbolic_ts", use_symbolic_ts);
+	planner_private_NH.getParam("symbolic_node_limit", symbolic_node_limit);
+	planner_private_NH.getParam("lazy_ts_threshold", lazy_ts_threshold);
+	if (use_symbolic_ts) {
+		env.symbolic_ts.reset(new SymbolicTS(dim_names, dim_labels));
+		SymbolicTS& symbolic_ts = *env.symbolic_ts;
+		symbolic_ts.setLabelGroup("object locations", obj_group);
+		symbolic_ts.setConditions(compiled_conds_m);
+		symbolic_ts.setPropositions(compiled_AP_m);
+		symbolic_ts.setNodeLimit(symbolic_node_limit);
+		if (!symbolic_ts.setInitState(set_state)) {
+			ROS_ERROR("Could not set up the symbolic transition system");
+			return false;
+		}
+		symbolic_ts.print();
+		if (!use_lazy_ts && lazy_ts_threshold > 0.0 && symbolic_ts.numReachable() > lazy_ts_threshold) {
+			ROS_WARN("Transition system has %.0f reachable states, using the lazy transition system", symbolic_ts.numReachable());
+			use_lazy_ts = true;
+		}
+	}
+
+	CompactTS& compact_ts = env.compact_ts;
+	// The lazy TS only generates the states the product searches reach, so
+	// there is no snapshot and no TS_EVAL for SymbSearch
+	if (use_lazy_ts) {
+		env.lazy_ts.reset(new LazyTS(dim_names, dim_labels));
+		LazyTS& lazy_ts = *env.lazy_ts;
+		lazy_ts.setLabelGroup("object locations", obj_group);
+		lazy_ts.setConditions(compiled_conds_m);
+		lazy_ts.setPropositions(compiled_AP_m);
+		if (!lazy_ts.setInitState(set_state)) {
+			ROS_ERROR("Could not set up the lazy transition system");
+			return false;
+		}
+		lazy_ts.print();
+	} else {
+		if (!compact_ts.setDimensions(dim_names, dim_labels)) {
+			ROS_ERROR("State space does not fit in a packed state");
+			return false;
+		}
+		compact_ts.setPropositionLabels(AP_m_labels);
+		if (use_ts_snapshot && compact_ts.map(snapshot_filename.str(), ts_key)) {
+			std::cout<<"Mapped the transition system snapshot: "<<snapshot_filename.str()<<std::endl;
+		} else {
+			bool generated = false;
+			if (use_ts_generator) {
+				// Parallel frontier expansion, same graph and node numbering as the serial expansion
+				// Conditions are compiled to ops on packed states, the interpreted Conditions stay as the reference path
+				TSGenerator ts_generator(&SS_MANIPULATOR, dim_names, dim_labels, &worker_pool);
+				ts_generator.setLabelGroup("object locations", obj_group);
+				ts_generator.setConditions(compiled_conds_m);
+				ts_generator.setPropositions(compiled_AP_m);
+				ts_generator.setReference(!use_compiled_conditions);
+				generated = ts_generator.generate(set_state, compact_ts);
+			}
+			if (!generated) {
+				ts_eval.generate();
+				env.ts_eval_ready = true;
+				generated = compact_ts.build(ts_eval, AP_m_ptrs);
+			}
+			if (use_ts_snapshot && generated) {
+				boost::filesystem::create_directories(ts_snapshot_dir);
+				if (compact_ts.save(snapshot_filename.str(), ts_key)) {
+					std::cout<<"Saved transition system snapshot: "<<snapshot_filename.str()<<std::endl;
+				}
+			}
+		}
+		compact_ts.print();
+	}
+
+	// Pattern databases over (eeLoc, objects, holding) for groups of
+	// pdb_group_size objects, saved next to the TS snapshot
+	bool use_pattern_db = true;
+	int pdb_group_size = 1;
+	planner_private_NH.getParam("use_pattern_db", use_pattern_db);
+	planner_private_NH.getParam("pdb_group_size", pdb_group_size);
+	PatternDB& pattern_db = env.pattern_db;
+	bool& pattern_db_ready = env.pattern_db_ready;
+	if (use_pattern_db && !use_lazy_ts) {
+		std::vector<std::vector<std::string>> patterns;
+		std::string pdb_key_str = ts_key_str;
+		for (int i=0; i<obj_group.size(); i+=std::max(pdb_group_size, 1)) {
+			std::vector<std::string> pattern = {"eeLoc"};
+			for (int j=i; j<std::min<int>(i + std::max(pdb_group_size, 1), obj_group.size()); ++j) {
+				pattern.push_back(obj_group[j]);
+			}
+			pattern.push_back("holding");
+			for (auto& dim_name : pattern) {
+				pdb_key_str += dim_name + ",";
+			}
+			pdb_key_str += "\n";
+			patterns.push_back(pattern);
+		}
+		const uint64_t pdb_key = fnv1a(pdb_key_str);
+		std::stringstream pdb_filename;
+		pdb_filename<<ts_snapshot_dir<<"/ts_"<<std::hex<<std::setw(16)<<std::setfill('0')<<ts_key<<"_"<<std::setw(16)<<pdb_key<<".pdb";
+		if (use_ts_snapshot && pattern_db.load(pdb_filename.str(), pdb_key, compact_ts)) {
+			std::cout<<"Restoring the pattern database from: "<<pdb_filename.str()<<std::endl;
+			pattern_db_ready = true;
+		} else if (pattern_db.build(compact_ts, patterns)) {
+			pattern_db_ready = true;
+			if (use_ts_snapshot) {
+				boost::filesystem::create_directories(ts_snapshot_dir);
+				pattern_db.save(pdb_filename.str(), pdb_key);
+			}
+		}
+		if (pattern_db_ready) {
+			pattern_db.print();
+		}
+	}
 	//std::cout<<"\n\n Printing the Transition System: \n\n"<<std::endl;
 	//ts_eval.print();
 
+	// Abstract TS over the object locations alone, whose plans are refined
+	// into the full TS. Picking an object up stands for transit and grasp,
+	// putting it down for transport and release
+	bool use_hierarchical_search = false;
+	planner_private_NH.getParam("use_hierarchical_search", use_hierarchical_search);
+	std::vector<std::vector<std::string>> abstract_dim_labels(obj_group.size(), loc_labels);
+	for (auto& labels : abstract_dim_labels) {
+		labels.push_back("ee");
+	}
+	if (use_hierarchical_search) {
+		env.abstract_ts.reset(new LazyTS(obj_group, abstract_dim_labels));
+		LazyTS& abstract_ts = *env.abstract_ts;
+		abstract_ts.setLabelGroup("object locations", obj_group);
+		std::vector<CompiledCondition> abstract_conds;
+		for (auto& obj : obj_group) {
+			std::vector<std::string> others;
+			for (auto& other : obj_group) {
+				if (other != obj) {
+					others.push_back(other);
+				}
+			}
+			abstract_ts.setLabelGroup(obj + " others", others);
+
+			CompiledCondition pick;
+			pick.addCondition(Condition::PRE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::VAR, "ee", Condition::NEGATE, "na");
+			pick.setCondJunctType(Condition::PRE, Condition::CONJUNCTION);
+			pick.addCondition(Condition::POST, Condition::LABEL, obj, Condition::EQUALS, Condition::VAR, "ee");
+			pick.setCondJunctType(Condition::POST, Condition::CONJUNCTION);
+			pick.setActionLabel("pick");
+			pick.setActionCost(compiled_conds_m[0].getActionCost());
+			abstract_conds.push_back(pick);
+
+			CompiledCondition place;
+			place.addCondition(Condition::PRE, Condition::LABEL, obj, Condition::EQUALS, Condition::VAR, "ee");
+			place.setCondJunctType(Condition::PRE, Condition::CONJUNCTION);
+			place.addCondition(Condition::POST, Condition::LABEL, obj, Condition::EQUALS, Condition::VAR, "ee", Condition::NEGATE, "na");
+			place.addCondition(Condition::POST, Condition::GROUP, obj + " others", Condition::ARG_FIND, Condition::LABEL, obj, Condition::NEGATE, "na");
+			place.setCondJunctType(Condition::POST, Condition::CONJUNCTION);
+			place.setActionLabel("place");
+			place.setActionCost(compiled_conds_m[1].getActionCost() + compiled_conds_m[2].getActionCost());
+			abstract_conds.push_back(place);
+		}
+		// Same propositions, nothing is held when no object is at "ee"
+		std::vector<CompiledCondition> abstract_AP;
+		for (auto& loc_label : loc_labels) {
+			for (auto& obj : obj_group) {
+				CompiledCondition ap;
+				ap.addCondition(Condition::SIMPLE, Condition::LABEL, obj, Condition::EQUALS, Condition::VAR, loc_label);
+				ap.addCondition(Condition::SIMPLE, Condition::GROUP, "object locations", Condition::ARG_FIND, Condition::VAR, "ee", Condition::NEGATE, "na");
+				ap.setCondJunctType(Condition::SIMPLE, Condition::CONJUNCTION);
+				ap.setLabel(obj + "_" + loc_label);
+				abstract_AP.push_back(ap);
+			}
+		}
+		abstract_ts.setConditions(abstract_conds);
+		abstract_ts.setPropositions(abstract_AP);
+		if (!abstract_ts.setInitState(init_obj_locations)) {
+			ROS_ERROR("Could not set up the abstract transition system");
+			return false;
+		}
+		env.hierarchical_search.reset(env.lazy_ts ? new HierarchicalSearch(&abstract_ts, env.lazy_ts.get()) : new HierarchicalSearch(&abstract_ts, &compact_ts));
+	}
+	return true;
+}
+
+int main(int argc, char** argv) {
+	ros::init(argc, argv, "planner_node");
+	ros::NodeHandle planner_NH;
+	ros::NodeHandle planner_private_NH("~");
+
+	// Worker threads shared by the planner tools:
+	int num_threads = std::thread::hardware_concurrency();
+	planner_private_NH.getParam("num_threads", num_threads);
+	WorkerPool worker_pool(num_threads);
+
+	std::unique_ptr<Environment> env(new Environment);
+	if (!buildEnvironment(*env, planner_NH, planner_private_NH, worker_pool)) {
+		return 1;
+	}
+
+
+	/* DFA cache and translators */
+	// Formulas outside of the native translator's fragment fall back to formula2dfa.py
+	std::string formula2dfa_path = ros::package::getPath("manipulation_interface") + "/task_planner/spot_automaton_file_dump";
+	std::string python_executable = std::string(getenv("HOME")) + "/anaconda3/envs/tpenv/bin/python";
+	std::string dfa_cache_dir = formula2dfa_path + "/dfa_cache";
+	planner_private_NH.getParam("python_executable", python_executable);
+	planner_private_NH.getParam("dfa_cache_dir", dfa_cache_dir);
+	std::string worker_script = ros::package::getPath("manipulation_interface") + "/scripts/formula2dfa_worker.py";
+	bool use_native_translator = true;
+	planner_private_NH.getParam("use_native_translator", use_native_translator);
+	LTLfTranslator native_translator;
+	TranslatorWorker translator(python_executable, worker_script, formula2dfa_path);
+	DFACache dfa_cache(dfa_cache_dir, use_native_translator ? &native_translator : nullptr, &translator);
+
+	bool use_product_search = true;
+	planner_private_NH.getParam("use_product_search", use_product_search);
+	if (env->lazy_ts && !use_product_search) {
+		ROS_WARN("Lazy transition system is only searched by the product search, enabling it");
+		use_product_search = true;
+	}
+	// Search once over the orderings of objects the formulas do not mention
+	bool use_symmetry_reduction = true;
+	planner_private_NH.getParam("use_symmetry_reduction", use_symmetry_reduction);
+	// Spread the exact pass of one query over the worker pool
+	bool use_parallel_search = false;
+	planner_private_NH.getParam("use_parallel_search", use_parallel_search);
+	// Exact cost to acceptance of each formula over the TS, kept across
+	// queries so that formulas seen before guide the search (in floats)
+	int accept_table_size = 1 << 24;
+	planner_private_NH.getParam("accept_table_size", accept_table_size);
+	// Times run() plans the rest again after an action fails
+	int max_replans = 3;
+	planner_private_NH.getParam("max_replans", max_replans);
+
+	// Complete plans by query and start state, written to plan_cache_file if
+	// set, every plan_cache_save_period seconds it changed in and on shutdown
+	int plan_cache_size = 1024;
+	std::string plan_cache_file;
+	double plan_cache_save_period = 10.0;
+	planner_private_NH.getParam("plan_cache_size", plan_cache_size);
+	planner_private_NH.getParam("plan_cache_file", plan_cache_file);
+	planner_private_NH.getParam("plan_cache_save_period", plan_cache_save_period);
+	PlanCache plan_cache(std::max(plan_cache_size, 0), plan_cache_file);
+	ros::Timer plan_cache_timer;
+	if (plan_cache.enabled() && !plan_cache_file.empty() && plan_cache_save_period > 0.0) {
+		plan_cache_timer = planner_NH.createTimer(ros::Duration(plan_cache_save_period), [&plan_cache](const ros::TimerEvent&) {plan_cache.flush();});
+	}
 
-	PlanSrv plan_obj(&ts_eval, obj_group, &planner_NH);
+	PlanSrv plan_obj(std::move(env), &dfa_cache, &plan_cache, use_product_search, use_symmetry_reduction, use_parallel_search, accept_table_size, max_replans, &worker_pool, &planner_NH, &planner_private_NH);
 	ros::ServiceServer plan_srv = planner_NH.advertiseService("/preference_planning_query", &PlanSrv::plan, &plan_obj);
+	ros::ServiceServer batch_plan_srv = planner_NH.advertiseService("/batch_preference_planning_query", &PlanSrv::batchPlan, &plan_obj);
+	ros::ServiceServer sweep_srv = planner_NH.advertiseService("/flexibility_sweep_query", &PlanSrv::sweep, &plan_obj);
 	ros::ServiceServer run_srv = planner_NH.advertiseService("/action_run_query", &PlanSrv::run, &plan_obj);
+	ros::ServiceServer extend_srv = planner_NH.advertiseService("/extend_environment", &PlanSrv::extendEnvironment, &plan_obj);
 	ROS_INFO("Plan and Run services are online!");
 	ros::spin();
 